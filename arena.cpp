@@ -0,0 +1,120 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace chip8asm
+{
+
+
+// the first block is big enough for a typical rom; later ones double
+constexpr size_t ARENA_MINIMUM_BLOCK = 64 * 1024;
+
+
+//
+//
+//
+
+Arena::~Arena()
+{
+    releaseBlocks();
+}
+
+
+//
+//
+//
+
+void Arena::releaseBlocks()
+{
+    while(m_blocks)
+    {
+        Block *next = m_blocks->next;
+        
+        free(m_blocks);
+        m_blocks = next;
+    }
+    
+    m_cursor = m_end = nullptr;
+}
+
+
+//
+//
+//
+
+void *Arena::allocateSlow(size_t size, size_t alignment)
+{
+    size_t blockSize = std::max(ARENA_MINIMUM_BLOCK, m_blocks ? m_blocks->size * 2 : 0);
+    blockSize = std::max(blockSize, size + alignment);
+    
+    Block *block = (Block *) malloc(sizeof(Block) + blockSize);
+    
+    if(!block)
+        throw std::bad_alloc();
+    
+    block->next = m_blocks;
+    block->size = blockSize;
+    
+    m_blocks = block;
+    m_cursor = (char *) (block + 1);
+    m_end = m_cursor + blockSize;
+    
+    return allocate(size, alignment);
+}
+
+
+//
+//
+//
+
+void Arena::reset()
+{
+    if(!m_blocks)
+        return;
+    
+    // an assembly that outgrew one block is replaced by a single block as big
+    // as all of them, so the next assembly of the same size never grows; past
+    // ARENA_RETAINED_SIZE the memory goes back, so one huge source does not
+    // leave a long-lived thread holding it for good
+    if(m_blocks->next  ||  m_blocks->size > ARENA_RETAINED_SIZE)
+    {
+        size_t total = std::min(capacity(), ARENA_RETAINED_SIZE);
+        
+        // less the byte allocateSlow() adds for the alignment
+        releaseBlocks();
+        allocateSlow(total - 1, 1);
+    }
+    
+    m_cursor = (char *) (m_blocks + 1);
+    m_end = m_cursor + m_blocks->size;
+}
+
+
+//
+//
+//
+
+size_t Arena::capacity() const
+{
+    size_t total = 0;
+    
+    for(Block *block = m_blocks; block; block = block->next)
+        total += block->size;
+    
+    return total;
+}
+
+
+//
+// every block but the newest counts as full, slack at its end and all
+//
+
+size_t Arena::used() const
+{
+    return m_blocks ? capacity() - (m_end - m_cursor) : 0;
+}
+
+
+}  // namespace chip8asm
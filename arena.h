@@ -0,0 +1,108 @@
+#ifndef CHIP8ASM_ARENA_H
+#define CHIP8ASM_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+namespace chip8asm
+{
+
+
+// the most memory reset() keeps for the next assembly; a rom's source needs
+// a fraction of it
+inline constexpr size_t ARENA_RETAINED_SIZE = 16 * 1024 * 1024;
+
+
+// bump allocator for everything one assembly creates; nothing is freed on
+// its own, reset() rewinds the whole arena at once and keeps up to
+// ARENA_RETAINED_SIZE of its memory for the next assembly
+class Arena
+{
+public:
+    Arena() = default;
+    ~Arena();
+    
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    void *allocate(size_t size, size_t alignment)
+    {
+        size_t padding = (alignment - (size_t) m_cursor % alignment) % alignment;
+        
+        if(padding + size > (size_t) (m_end - m_cursor))
+            return allocateSlow(size, alignment);
+        
+        void *memory = m_cursor + padding;
+        m_cursor += padding + size;
+        return memory;
+    }
+    
+    void reset();
+    
+    size_t capacity() const;
+    size_t used() const;     // bytes handed out since the last reset
+
+private:
+    struct Block
+    {
+        Block *next;
+        size_t size;     // bytes following the header
+    };
+    
+    void *allocateSlow(size_t size, size_t alignment);
+    void releaseBlocks();
+    
+    Block *m_blocks = nullptr;   // newest first; the cursor is in the newest
+    char *m_cursor = nullptr;
+    char *m_end = nullptr;
+};
+
+
+// lets standard containers live in an arena; without one it falls back to
+// the heap, so the containers still work on their own
+template<typename T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    
+    Arena *arena;
+    
+    ArenaAllocator(Arena *arena = nullptr)  : arena(arena) {}
+    
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)  : arena(other.arena) {}
+    
+    T *allocate(size_t count)
+    {
+        if(arena)
+            return (T *) arena->allocate(count * sizeof(T), alignof(T));
+        
+        return (T *) ::operator new(count * sizeof(T));
+    }
+    
+    void deallocate(T *memory, size_t)
+    {
+        if(!arena)
+            ::operator delete(memory);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  { return a.arena == b.arena; }
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  { return a.arena != b.arena; }
+
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+}  // namespace chip8asm
+
+
+#endif
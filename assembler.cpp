@@ -0,0 +1,1159 @@
+#include "chip8asm.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "context.h"
+#include "image.h"
+#include "operands.h"
+
+
+namespace chip8asm
+{
+
+
+struct MnemonicSlot;
+typedef bool (*MnemonicHandler)(Context& context, const MnemonicSlot& slot, TokenList& tokens);
+
+
+struct Mnemonic
+{
+    std::string_view name;
+    MnemonicHandler handler;
+};
+
+
+struct MnemonicSlot
+{
+    int8_t mnemonic;
+    uint8_t firstForm;
+    uint8_t formCount;
+};
+
+
+constexpr int MNEMONIC_HASH_SIZE = 64;
+
+
+//
+//
+//
+
+void Context::reset(const Options& options)
+{
+    this->options = options;
+    
+    // drop the containers' arena memory before rewinding the arena under them
+    symbols = SymbolTable(&arena);
+    statements = ArenaVector<Statement>(&arena);
+    statementLines = ArenaVector<int>(&arena);
+    blocks = ArenaVector<DataBlock>(&arena);
+    expressions = ArenaVector<Expression>(&arena);
+    terms = ArenaVector<ExpressionTerm>(&arena);
+    constants = ArenaVector<Constant>(&arena);
+    fixups = ArenaVector<Fixup>(&arena);
+    arena.reset();
+    
+    binaries.clear();
+    
+    diagnostics.clear();
+    stats = Statistics();
+    lineNumber = 0;
+    offset = 0x0200;
+    relative = false;
+    firstAbsolute = 0;
+    relativeEnd = 0;
+    lineLabel = SYMBOL_NONE;
+    lineOrigin = false;
+    lineConstant = false;
+    image = nullptr;
+    freeFixups = 0;
+}
+
+
+//
+//
+//
+
+void Context::error(int line, int column, const char *format, ...)
+{
+    char message[256];
+    va_list arguments;
+    
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    
+    diagnostics.push_back({ line, column, message });
+}
+
+
+//
+// the address a label operand stands for, once the label is defined
+//
+
+bool symbolAddress(Context& context, uint32_t id, uint32_t& address)
+{
+    const Symbol& symbol = context.symbols.symbols[id];
+    std::string_view name = context.symbols.name(id);
+    
+    if(symbol.value < 0)
+    {
+        context.error(symbol.line, -1, "undefined symbol '%.*s'", (int) name.size(), name.data());
+        return false;
+    }
+    
+    if(symbol.value > 0xfff)
+    {
+        context.error(symbol.line, -1, "symbol '%.*s' is out of range", (int) name.size(), name.data());
+        return false;
+    }
+    
+    address = symbol.value;
+    return true;
+}
+
+
+//
+// the value of an expression with the labels defined so far
+//
+
+ExpressionResult evaluate(const Context& context, const Expression& expression)
+{
+    const Symbol *symbols = context.symbols.symbols.data();
+    
+    return evaluateExpression(&context.terms[expression.firstTerm], expression.termCount, [symbols](uint32_t id, int& value)
+    {
+        value = symbols[id].value;
+        return value >= 0;
+    });
+}
+
+
+//
+// the value a label or expression operand comes to; with pending, a label
+// that is not defined yet is not an error but is handed back in *pending
+//
+
+bool resolveOperand(Context& context, const Statement& statement, uint32_t& operand, uint32_t *pending)
+{
+    if(statement.operand & STATEMENT_SYMBOL)
+    {
+        uint32_t id = statement.operand & ~STATEMENT_SYMBOL;
+        
+        if(pending  &&  context.symbols.symbols[id].value < 0)
+        {
+            *pending = id;
+            return true;
+        }
+        
+        return symbolAddress(context, id, operand);
+    }
+    
+    if(!(statement.operand & STATEMENT_EXPRESSION))
+    {
+        operand = statement.operand;
+        return true;
+    }
+    
+    
+    const Expression& expression = context.expressions[statement.operand & ~STATEMENT_EXPRESSION];
+    ExpressionResult result = evaluate(context, expression);
+    uint32_t mask = g_instructionEncodings.encodings[statement.instruction].operandMask;
+    
+    switch(result.status)
+    {
+        case EXPRESSION_PENDING:
+            if(pending)
+            {
+                *pending = result.symbol;
+                return true;
+            }
+            
+            return symbolAddress(context, result.symbol, operand);
+        
+        case EXPRESSION_ERROR:
+            context.error(expression.line, -1, "%s", result.error);
+            return false;
+    }
+    
+    if(!operandFits(result.value, mask))
+    {
+        context.error(expression.line, -1, "expression is out of range");
+        return false;
+    }
+    
+    operand = result.value & mask;
+    return true;
+}
+
+
+//
+// places the encoded bytes, or a data block's bytes, at the statement's own
+// address
+//
+
+bool emitStatement(Context& context, RomImage& image, const Statement& statement, uint32_t operand, int line)
+{
+    int address = statement.offset;
+    int size;
+    bool stored;
+    
+    if(statement.instruction == INST_DATABLOCK)
+    {
+        const DataBlock& block = context.blocks[operand];
+        
+        size = block.size;
+        stored = storeBytes(image, address, block.bytes, block.size, block.value);
+    }
+    else
+    {
+        uint16_t word;
+        
+        if(!encodeStatement(statement, operand, word))
+        {
+            context.error(line, -1, "unexpected instruction %d", statement.instruction);
+            return false;
+        }
+        
+        size = statementSize(statement);
+        
+        if(size == 1)
+            stored = storeByte(image, address, word);
+        else
+            stored = storeByte(image, address, word >> 8)  &&  storeByte(image, address + 1, word);
+    }
+    
+    if(!stored)
+    {
+        if(address + size > 0x10000)
+            context.error(line, -1, "statement at $%04x extends past the end of memory", address);
+        else
+            context.error(line, -1, "statement at $%04x overlaps previously emitted bytes", address);
+        
+        return false;
+    }
+    
+    context.stats.bytes += size;
+    return true;
+}
+
+
+//
+// chains a single-pass statement onto the fixups of the label it waits for
+//
+
+void addFixup(Context& context, const Statement& statement, uint32_t id)
+{
+    Symbol& symbol = context.symbols.symbols[id];
+    uint32_t fixup = context.freeFixups;
+    
+    if(fixup)
+        context.freeFixups = context.fixups[fixup - 1].next;
+    else
+    {
+        context.fixups.push_back({ statement, 0 });
+        fixup = context.fixups.size();
+    }
+    
+    Fixup& entry = context.fixups[fixup - 1];
+    entry.statement = statement;
+    entry.next = symbol.fixups;
+    symbol.fixups = fixup;
+}
+
+
+//
+// whether size more bytes fit between the offset and the end of memory; a
+// chunk counting from zero is checked again once its base is known
+//
+
+bool fitsInMemory(Context& context, int size)
+{
+    if(context.offset + size <= 0x10000)
+        return true;
+    
+    context.error(context.lineNumber, -1, "statement extends past the end of memory");
+    return false;
+}
+
+
+//
+// keeps a parsed statement for the later passes, or in a single-pass
+// assembly emits it on the spot; a reference to a label not defined yet is
+// emitted with a zero operand and chained onto the label's fixups
+//
+
+bool addStatement(Context& context, const Statement& statement)
+{
+    if(!context.image)
+    {
+        context.statements.push_back(statement);
+        context.statementLines.push_back(context.lineNumber);
+        return true;
+    }
+    
+    ++context.stats.statements;
+    
+    uint32_t operand = 0;
+    uint32_t pending = SYMBOL_NONE;
+    
+    if(!resolveOperand(context, statement, operand, &pending))
+        return false;
+    
+    if(pending != SYMBOL_NONE)
+        addFixup(context, statement, pending);
+    
+    return emitStatement(context, *context.image, statement, operand, context.lineNumber);
+}
+
+
+//
+// a data line becomes a single statement for its whole block
+//
+
+bool addBlock(Context& context, const DataBlock& block)
+{
+    if(!fitsInMemory(context, block.size))
+        return false;
+    
+    Statement statement = {};
+    statement.instruction = INST_DATABLOCK;
+    statement.offset = context.offset;
+    statement.operand = context.blocks.size();
+    
+    context.blocks.push_back(block);
+    context.offset += block.size;
+    
+    bool added = addStatement(context, statement);
+    
+    // a single-pass assembly has copied the block into the image already
+    if(context.image)
+    {
+        if(block.mapped)
+            context.binaries.pop_back();
+        
+        context.blocks.pop_back();
+    }
+    
+    return added;
+}
+
+
+//
+// a label just defined in a single-pass assembly patches the references
+// that were waiting for it and hands their fixups back for reuse; an
+// expression that still names another undefined label waits for that one
+//
+
+bool patchFixups(Context& context, uint32_t id)
+{
+    Symbol& symbol = context.symbols.symbols[id];
+    uint32_t fixup = 0;
+    
+    // the chain runs newest first; turned around, an error is reported at
+    // the earliest reference, as a two-pass assembly reports it
+    for(uint32_t entry = symbol.fixups; entry; )
+    {
+        uint32_t next = context.fixups[entry - 1].next;
+        
+        context.fixups[entry - 1].next = fixup;
+        fixup = entry;
+        entry = next;
+    }
+    
+    symbol.fixups = 0;
+    
+    while(fixup)
+    {
+        Fixup& entry = context.fixups[fixup - 1];
+        const Statement& statement = entry.statement;
+        uint32_t next = entry.next;
+        uint32_t operand = 0;
+        uint32_t pending = SYMBOL_NONE;
+        
+        if(!resolveOperand(context, statement, operand, &pending))
+            return false;
+        
+        if(pending != SYMBOL_NONE)
+        {
+            entry.next = context.symbols.symbols[pending].fixups;
+            context.symbols.symbols[pending].fixups = fixup;
+        }
+        else
+        {
+            uint16_t word = encodeInstruction(statement.instruction, statement.x, statement.y, operand);
+            
+            if(statementSize(statement) == 1)
+                patchByte(*context.image, statement.offset, word);
+            else
+            {
+                patchByte(*context.image, statement.offset, word >> 8);
+                patchByte(*context.image, statement.offset + 1, word);
+            }
+            
+            entry.next = context.freeFixups;
+            context.freeFixups = fixup;
+        }
+        
+        fixup = next;
+    }
+    
+    return true;
+}
+
+
+//
+// the id of a name used in an operand, interned on first use
+//
+
+uint32_t referenceLabel(Context& context, std::string_view name)
+{
+    uint32_t id = context.symbols.intern(name);
+    Symbol& symbol = context.symbols.symbols[id];
+    
+    if(symbol.line == 0)
+        symbol.line = context.lineNumber;
+    
+    return id;
+}
+
+
+//
+// folds terms naming nothing but literals and constants into their value;
+// anything naming a label comes back pending
+//
+
+ExpressionResult foldTerms(const Context& context, const ExpressionTerm *terms, int count)
+{
+    const Symbol *symbols = context.symbols.symbols.data();
+    
+    return evaluateExpression(terms, count, [symbols](uint32_t id, int& value)
+    {
+        value = symbols[id].value;
+        return symbols[id].constant;
+    });
+}
+
+
+//
+// keeps terms for resolution, returning the operand that refers to them
+//
+
+uint32_t storeExpression(Context& context, const ExpressionTerm *terms, int count)
+{
+    uint32_t index = context.expressions.size();
+    
+    context.expressions.push_back({ (uint32_t) context.terms.size(), (uint32_t) count, context.lineNumber });
+    
+    for(int term = 0; term < count; ++term)
+        context.terms.push_back(terms[term]);
+    
+    return STATEMENT_EXPRESSION | index;
+}
+
+
+//
+//
+//
+
+bool parseInstruction(Context& context, const MnemonicSlot& slot, TokenList& tokens)
+{
+    Statement statement;
+    
+    if(matchForm(context, slot.firstForm, slot.formCount, &tokens[0] + 1, tokens.size() - 1, statement))
+    {
+        statement.offset = context.offset;
+        
+        if(!fitsInMemory(context, statementSize(statement))  ||  !addStatement(context, statement))
+            return false;
+        
+        context.offset += statementSize(statement);
+        return true;
+    }
+    
+    context.error(context.lineNumber, -1, "missing, unexpected, or invalid argument(s) to '%.*s'", (int) tokens[0].text.size(), tokens[0].text.data());
+    return false;
+}
+
+
+//
+//
+//
+
+bool parseOrigin(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    int origin = 0;
+    
+    if(tokens.size() != 2  ||  !parseConstant(context, tokens[1], 0xffff, origin))
+    {
+        context.error(context.lineNumber, -1, "missing, unexpected, or invalid argument(s) to '.org'");
+        return false;
+    }
+    
+    if(context.relative)
+    {
+        context.relative = false;
+        context.firstAbsolute = context.statements.size();
+        context.relativeEnd = context.offset;
+    }
+    
+    context.lineOrigin = true;
+    context.offset = origin;
+    return true;
+}
+
+
+//
+// .byte and .word values, gathered big endian into one block; a line with
+// a value that has to wait for the labels is kept a statement per value
+//
+
+bool parseData(Context& context, TokenList& tokens, int instruction, const char *directive)
+{
+    if(tokens.size() < 2)
+    {
+        context.error(context.lineNumber, -1, "missing argument to '%s'", directive);
+        return false;
+    }
+    
+    const InstructionEncoding& encoding = g_instructionEncodings.encodings[instruction];
+    uint32_t size = (tokens.size() - 1) * encoding.size;
+    uint8_t *bytes = (uint8_t *) context.arena.allocate(size, 1);
+    uint8_t *cursor = bytes;
+    uint32_t operands[MAX_TOKENS];
+    bool folded = true;
+    
+    for(int index = 1; index < tokens.size(); ++index)
+    {
+        const Token& token = tokens[index];
+        uint32_t& operand = operands[index - 1];
+        
+        if(token.isInteger(encoding.operandMask))
+            operand = token.value;
+        else if(!parseValue(context, token, encoding.operandMask, operand))
+        {
+            context.error(context.lineNumber, token.column, "invalid argument to '%s'", directive);
+            return false;
+        }
+        
+        folded = folded  &&  !(operand & STATEMENT_EXPRESSION);
+        
+        if(encoding.size == 2)
+            *cursor++ = operand >> 8;
+        
+        *cursor++ = operand;
+    }
+    
+    if(!folded)
+    {
+        if(!fitsInMemory(context, size))
+            return false;
+        
+        Statement statement = {};
+        statement.instruction = instruction;
+        
+        for(int index = 0; index < tokens.size() - 1; ++index)
+        {
+            statement.offset = context.offset;
+            statement.operand = operands[index];
+            
+            if(!addStatement(context, statement))
+                return false;
+            
+            context.offset += encoding.size;
+        }
+        
+        return true;
+    }
+    
+    return addBlock(context, { bytes, size, 0, false });
+}
+
+
+//
+//
+//
+
+bool parseDefineByte(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    return parseData(context, tokens, INST_DEFINEBYTE, ".byte");
+}
+
+
+//
+//
+//
+
+bool parseDefineWord(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    return parseData(context, tokens, INST_DEFINEWORD, ".word");
+}
+
+
+//
+// .fill count, value and .space count, which fills with zeros
+//
+
+bool parseFill(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    bool space = tokens[0].lower == ".space";
+    int count = 0;
+    int value = 0;
+    
+    if(tokens.size() != (space ? 2 : 3)  ||  !parseConstant(context, tokens[1], 0x10000, count)  ||  (!space  &&  !parseConstant(context, tokens[2], 0xff, value)))
+    {
+        context.error(context.lineNumber, -1, "missing, unexpected, or invalid argument(s) to '%s'", space ? ".space" : ".fill");
+        return false;
+    }
+    
+    return addBlock(context, { nullptr, (uint32_t) count, (uint8_t) value, false });
+}
+
+
+//
+// .equ name, value defines a constant; a value over literals and earlier
+// constants is known at once and folds into whatever uses the constant, a
+// value naming labels is assigned when they resolve
+//
+
+bool parseEquate(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    ExpressionTerm terms[MAX_EXPRESSION_TERMS];
+    int count = 0;
+    
+    if(tokens.size() != 3  ||  tokens[1].kind != TOKEN_SYMBOL  ||  !parseTerms(context, tokens[2], terms, count))
+    {
+        context.error(context.lineNumber, -1, "missing, unexpected, or invalid argument(s) to '.equ'");
+        return false;
+    }
+    
+    std::string_view name = tokens[1].text;
+    uint32_t id = context.symbols.intern(tokens[1].lower);
+    
+    if(context.symbols.symbols[id].value >= 0)
+    {
+        context.error(context.lineNumber, tokens[1].column, "'%.*s' is already defined", (int) name.size(), name.data());
+        return false;
+    }
+    
+    context.lineConstant = true;
+    
+    ExpressionResult result = foldTerms(context, terms, count);
+    
+    if(result.status == EXPRESSION_PENDING)
+    {
+        // labels after this line are not known to a single-pass assembly
+        if(context.image)
+        {
+            std::string_view label = context.symbols.name(result.symbol);
+            
+            context.error(context.lineNumber, tokens[2].column, "'.equ' value names '%.*s', which is not a constant defined before it", (int) label.size(), label.data());
+            return false;
+        }
+        
+        context.constants.push_back({ id, storeExpression(context, terms, count) & ~STATEMENT_EXPRESSION });
+        return true;
+    }
+    
+    if(result.status == EXPRESSION_ERROR)
+    {
+        context.error(context.lineNumber, tokens[2].column, "%s", result.error);
+        return false;
+    }
+    
+    if(result.value < 0  ||  result.value > 0xffff)
+    {
+        context.error(context.lineNumber, tokens[2].column, "constant is out of range");
+        return false;
+    }
+    
+    Symbol& symbol = context.symbols.symbols[id];
+    symbol.value = result.value;
+    symbol.constant = true;
+    
+    return !context.image  ||  patchFixups(context, id);
+}
+
+
+//
+// .incbin "file" maps the file and copies it into the image as it is
+//
+
+bool parseIncludeBinary(Context& context, const MnemonicSlot&, TokenList& tokens)
+{
+    // the path is split into tokens wherever it has spaces or commas, so it
+    // is taken from the line as written, quote to quote
+    const char *first = tokens.size() < 2 ? nullptr : tokens[1].text.data();
+    const char *last = tokens.size() < 2 ? nullptr : tokens[tokens.size() - 1].text.data() + tokens[tokens.size() - 1].text.size();
+    
+    if(!first  ||  last - first < 3  ||  first[0] != '"'  ||  last[-1] != '"')
+    {
+        context.error(context.lineNumber, -1, "missing, unexpected, or invalid argument(s) to '.incbin'");
+        return false;
+    }
+    
+    std::string path(first + 1, last - 1);
+    std::unique_ptr<SourceFile> file = std::make_unique<SourceFile>();
+    
+    // an absolute path replaces the directory rather than joining it
+    if(!openSource((std::filesystem::path(context.options.includeDirectory) / path).string(), *file))
+    {
+        context.error(context.lineNumber, tokens[1].column, "error opening binary file \"%s\"", path.c_str());
+        return false;
+    }
+    
+    if(file->size > 0x10000)
+    {
+        context.error(context.lineNumber, tokens[1].column, "binary file \"%s\" is larger than memory", path.c_str());
+        return false;
+    }
+    
+    DataBlock block = { (const uint8_t *) file->data, (uint32_t) file->size, 0, true };
+    
+    context.binaries.push_back(std::move(file));
+    return addBlock(context, block);
+}
+
+
+//
+// every mnemonic and directive the assembler understands, looked up through
+// a perfect hash built at compile time
+//
+
+constexpr Mnemonic g_mnemonics[] =
+{
+    { ".byte",   parseDefineByte },
+    { ".equ",    parseEquate },
+    { ".fill",   parseFill },
+    { ".incbin", parseIncludeBinary },
+    { ".org",    parseOrigin },
+    { ".space",  parseFill },
+    { ".word",   parseDefineWord },
+    { "add",     parseInstruction },
+    { "and",     parseInstruction },
+    { "call",    parseInstruction },
+    { "cls",     parseInstruction },
+    { "drw",     parseInstruction },
+    { "jp",      parseInstruction },
+    { "ld",      parseInstruction },
+    { "or",      parseInstruction },
+    { "ret",     parseInstruction },
+    { "rnd",     parseInstruction },
+    { "se",      parseInstruction },
+    { "shl",     parseInstruction },
+    { "shr",     parseInstruction },
+    { "sknp",    parseInstruction },
+    { "skp",     parseInstruction },
+    { "sne",     parseInstruction },
+    { "sub",     parseInstruction },
+    { "subn",    parseInstruction },
+    { "xor",     parseInstruction }
+};
+
+constexpr int MNEMONIC_COUNT = sizeof(g_mnemonics) / sizeof(g_mnemonics[0]);
+
+
+constexpr unsigned mnemonicHash(std::string_view name)
+{
+    // or'ing in 0x20 folds letters to lowercase without a table lookup
+    return ((unsigned) name.size() +
+        (name[0] | 0x20) * 6 +
+        (name[1] | 0x20) * 5 +
+        (name[name.size() - 1] | 0x20)) & (MNEMONIC_HASH_SIZE - 1);
+}
+
+
+struct MnemonicHashTable
+{
+    MnemonicSlot slots[MNEMONIC_HASH_SIZE];
+    bool valid;
+};
+
+
+constexpr MnemonicHashTable buildMnemonicHashTable()
+{
+    MnemonicHashTable table = {};
+    table.valid = true;
+    
+    for(int slot = 0; slot < MNEMONIC_HASH_SIZE; ++slot)
+        table.slots[slot].mnemonic = -1;
+    
+    for(int index = 0; index < MNEMONIC_COUNT; ++index)
+    {
+        std::string_view name = g_mnemonics[index].name;
+        MnemonicSlot& slot = table.slots[mnemonicHash(name)];
+        
+        // two mnemonics sharing a slot means the hash is no longer perfect
+        if(name.size() < 2  ||  slot.mnemonic != -1)
+            table.valid = false;
+        
+        slot.mnemonic = index;
+        slot.firstForm = 0;
+        slot.formCount = 0;
+        
+        // forms of one mnemonic must sit next to each other in the form table
+        for(int form = 0; form < INSTRUCTION_FORM_COUNT; ++form)
+        {
+            if(name.compare(g_instructionForms[form].mnemonic) != 0)
+                continue;
+            
+            if(slot.formCount == 0)
+                slot.firstForm = form;
+            else if(slot.firstForm + slot.formCount != form)
+                table.valid = false;
+            
+            ++slot.formCount;
+        }
+    }
+    
+    return table;
+}
+
+
+constexpr MnemonicHashTable g_mnemonicHashTable = buildMnemonicHashTable();
+
+static_assert(g_mnemonicHashTable.valid, "mnemonic hash has collisions or instruction forms are not grouped");
+
+
+const MnemonicSlot *findMnemonic(std::string_view text)
+{
+    if(text.size() < 2)
+        return nullptr;
+    
+    const MnemonicSlot& slot = g_mnemonicHashTable.slots[mnemonicHash(text)];
+    
+    if(slot.mnemonic == -1  ||  text != g_mnemonics[slot.mnemonic].name)
+        return nullptr;
+    
+    return &slot;
+}
+
+
+//
+//
+//
+
+bool parseLine(Context& context, std::string_view line)
+{
+    TokenList& tokens = context.tokens;
+    bool profile = context.options.profile;
+    Clock::time_point start;
+    
+    context.lineLabel = SYMBOL_NONE;
+    context.lineOrigin = false;
+    context.lineConstant = false;
+    
+    if(profile)
+        start = Clock::now();
+    
+    bool tokenized = split(context, line, tokens);
+    
+    if(profile)
+        context.stats.tokenizeTime += secondsSince(start);
+    
+    if(!tokenized)
+        return false;
+    
+    context.stats.tokens += tokens.size();
+    
+    if(tokens.empty())
+        return true;
+    
+    
+    // handle optional label
+    if(tokens[0].text.back() == ':')
+    {
+        std::string_view label = tokens[0].lower.substr(0, tokens[0].lower.size() - 1);
+        
+        if(profile)
+            start = Clock::now();
+        
+        context.lineLabel = context.symbols.intern(label);
+        Symbol& symbol = context.symbols.symbols[context.lineLabel];
+        
+        // a label is defined once; references before a second single-pass
+        // definition would already hold the first address, so both modes
+        // reject it rather than differ
+        if(symbol.value >= 0)
+        {
+            context.error(context.lineNumber, -1, "label '%.*s' is already defined", (int) label.size(), label.data());
+            return false;
+        }
+        
+        symbol.value = context.offset | (context.relative ? SYMBOL_RELATIVE : 0);
+        
+        bool patched = !context.image  ||  patchFixups(context, context.lineLabel);
+        
+        if(profile)
+            context.stats.defineTime += secondsSince(start);
+        
+        if(!patched)
+            return false;
+        
+        if(tokens.size() < 2)
+            return true;
+        else
+            tokens.pop_front();
+    }
+    
+    
+    // put operands with spaces around their operators back together
+    tokens.count = tokens.first + joinExpressions(&tokens[0], tokens.size());
+    
+    
+    // dispatch to the directive or instruction handler
+    const MnemonicSlot *slot = findMnemonic(tokens[0].lower);
+    
+    if(!slot)
+    {
+        context.error(context.lineNumber, -1, "unknown instruction %.*s", (int) tokens[0].text.size(), tokens[0].text.data());
+        return false;
+    }
+    
+    return g_mnemonics[slot->mnemonic].handler(context, *slot, tokens);
+}
+
+
+//
+//
+//
+
+bool parseSource(Context& context, std::string_view source)
+{
+    const char *cursor = source.data();
+    const char *end = source.data() + source.size();
+    
+    // timing every line costs a little, so it is only done when asked; parse
+    // time is whatever the line timings leave over
+    Clock::time_point parseStart = Clock::now();
+    double lineTime = context.stats.tokenizeTime + context.stats.defineTime;
+    
+    // source lines rarely run shorter than this, so growing the statement
+    // vector is the exception rather than the rule; a single-pass assembly
+    // keeps no statements
+    if(!context.image)
+        context.statements.reserve(context.statements.size() + source.size() / 16);
+    
+    
+    // walk the source line-by-line, tokenizing in place
+    for(context.lineNumber = 1; cursor < end; ++context.lineNumber)
+    {
+        const char *newline = (const char *) memchr(cursor, '\n', end - cursor);
+        const char *lineEnd = newline ? newline : end;
+        
+        std::string_view line(cursor, lineEnd - cursor);
+        cursor = lineEnd + 1;
+        
+        if(!parseLine(context, line))
+            break;
+    }
+    
+    
+    if(context.options.profile)
+    {
+        lineTime = context.stats.tokenizeTime + context.stats.defineTime - lineTime;
+        context.stats.parseTime += secondsSince(parseStart) - lineTime;
+    }
+    
+    return context.diagnostics.empty();
+}
+
+
+//
+//
+//
+
+bool resolveSymbols(Context& context)
+{
+    // constants that name labels come first, in source order, so one may
+    // use those before it
+    for(const Constant& constant : context.constants)
+    {
+        const Expression& expression = context.expressions[constant.expression];
+        Symbol& symbol = context.symbols.symbols[constant.symbol];
+        std::string_view name = context.symbols.name(constant.symbol);
+        ExpressionResult result = evaluate(context, expression);
+        uint32_t address;
+        
+        if(symbol.value >= 0)
+        {
+            context.error(expression.line, -1, "'%.*s' is already defined", (int) name.size(), name.data());
+            return false;
+        }
+        
+        if(result.status == EXPRESSION_PENDING)
+            return symbolAddress(context, result.symbol, address);
+        
+        if(result.status == EXPRESSION_ERROR)
+        {
+            context.error(expression.line, -1, "%s", result.error);
+            return false;
+        }
+        
+        if(result.value < 0  ||  result.value > 0xffff)
+        {
+            context.error(expression.line, -1, "constant is out of range");
+            return false;
+        }
+        
+        symbol.value = result.value;
+        symbol.constant = true;
+    }
+    
+    
+    // replace each label or expression operand with its value
+    for(Statement& statement : context.statements)
+    {
+        if(!(statement.operand & (STATEMENT_SYMBOL | STATEMENT_EXPRESSION)))
+            continue;
+        
+        if(!resolveOperand(context, statement, statement.operand, nullptr))
+            return false;
+    }
+    
+    return true;
+}
+
+
+//
+// whatever fixups are left at the end of a single-pass assembly wait for
+// labels that were never defined; ids follow first mention, so the first
+// one reported is the one a two-pass assembly would report
+//
+
+bool resolveFixups(Context& context)
+{
+    uint32_t address;
+    
+    for(uint32_t id = 1; id < context.symbols.symbols.size(); ++id)
+    {
+        if(context.symbols.symbols[id].fixups  &&  !symbolAddress(context, id, address))
+            return false;
+    }
+    
+    return true;
+}
+
+
+//
+//
+//
+
+bool encodeStatement(const Statement& statement, uint32_t operand, uint16_t& word)
+{
+    // a data block has no single word to encode
+    if(statement.instruction >= INST_COUNT  ||  statement.instruction == INST_DATABLOCK)
+        return false;
+    
+    word = encodeInstruction(statement.instruction, statement.x, statement.y, operand);
+    return true;
+}
+
+
+//
+//
+//
+
+bool encodeStatements(Context& context, RomImage& image)
+{
+    for(size_t index = 0; index < context.statements.size(); ++index)
+    {
+        const Statement& statement = context.statements[index];
+        
+        if(!emitStatement(context, image, statement, statement.operand, context.statementLines[index]))
+            return false;
+    }
+    
+    
+    return true;
+}
+
+
+//
+//
+//
+
+Assembler::Assembler(const Options& options)
+    : m_options(options)
+{
+}
+
+
+//
+//
+//
+
+Result Assembler::assemble(std::string_view source) const
+{
+    // each thread keeps its context, so back-to-back assemblies reuse the
+    // same arena instead of going back to the heap
+    thread_local Context context;
+    context.reset(m_options);
+    
+    RomImage image(context.arena);
+    image.fill = m_options.fill;
+    
+    Result result;
+    
+    // a single-pass assembly emits as it parses, so all that is left after
+    // the parse is to report references to labels never defined
+    if(m_options.singlePass)
+    {
+        context.image = &image;
+        result.success = parseSource(context, source);
+        
+        if(result.success)
+        {
+            Clock::time_point start = Clock::now();
+            
+            result.success = resolveFixups(context);
+            context.stats.resolveTime = secondsSince(start);
+        }
+    }
+    else
+    {
+        result.success = parseSourceParallel(context, source, m_options.threads);
+        
+        if(result.success)
+        {
+            Clock::time_point start = Clock::now();
+            
+            result.success = resolveSymbols(context);
+            context.stats.resolveTime = secondsSince(start);
+        }
+        
+        if(result.success)
+        {
+            Clock::time_point start = Clock::now();
+            
+            result.success = encodeStatements(context, image);
+            context.stats.emitTime = secondsSince(start);
+        }
+    }
+    
+    if(result.success)
+    {
+        Clock::time_point start = Clock::now();
+        
+        flattenImage(image, result.image);
+        result.origin = image.lowest <= image.highest ? image.lowest : 0;
+        
+        context.stats.emitTime += secondsSince(start);
+    }
+    
+    result.diagnostics.swap(context.diagnostics);
+    result.stats = context.stats;
+    result.stats.lines = context.lineNumber - 1;
+    result.stats.statements = m_options.singlePass ? context.stats.statements : context.statements.size();
+    result.stats.symbols = context.symbols.size();
+    return result;
+}
+
+
+}  // namespace chip8asm
@@ -0,0 +1,743 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chip8asm.h"
+#include "context.h"
+#include "generator.h"
+#include "image.h"
+#include "interpreter.h"
+#include "scanner.h"
+#include "server.h"
+#include "source.h"
+#include "tokenizer.h"
+
+#ifdef CHIP8ASM_POSIX
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+
+using namespace chip8asm;
+
+
+// benchmark settings, set from the command line
+const char *g_filter = nullptr;
+double g_minimumTime = 0.5;
+
+// results are folded in here so the optimizer cannot drop the work
+volatile uint64_t g_sink;
+
+
+//
+// runs function repeatedly for at least g_minimumTime seconds and reports
+// the time per run and the throughput in items and bytes
+//
+
+template<typename Function>
+void runBenchmark(const char *name, size_t items, const char *itemName, size_t bytes, Function function)
+{
+    if(g_filter  &&  !strstr(name, g_filter))
+        return;
+    
+    typedef std::chrono::steady_clock Clock;
+    
+    function();
+    
+    size_t runs = 0;
+    double elapsed = 0;
+    Clock::time_point start = Clock::now();
+    
+    do
+    {
+        function();
+        ++runs;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    while(elapsed < g_minimumTime);
+    
+    double seconds = elapsed / runs;
+    
+    printf("%-32s %12.0f ns/run %14.0f %s/s", name, seconds * 1e9, items / seconds, itemName);
+    
+    if(bytes)
+        printf(" %10.1f MB/s", bytes / seconds / 1e6);
+    
+    printf("\n");
+}
+
+
+//
+//
+//
+
+std::vector<std::string_view> splitLines(std::string_view source)
+{
+    std::vector<std::string_view> lines;
+    
+    while(!source.empty())
+    {
+        size_t newline = source.find('\n');
+        
+        lines.push_back(source.substr(0, newline));
+        source.remove_prefix(newline == std::string_view::npos ? source.size() : newline + 1);
+    }
+    
+    return lines;
+}
+
+
+//
+// the integer parser as it was before, copying the token for strtol
+//
+
+bool parseIntegerStrtol(std::string_view text, int& result, int maxValue)
+{
+    char buffer[64];
+    
+    if(text.empty()  ||  text.size() >= sizeof(buffer))
+        return false;
+    
+    text.copy(buffer, text.size());
+    buffer[text.size()] = '\0';
+    
+    const char *digits = buffer;
+    char *end;
+    
+    if(buffer[0] == '$')
+        result = (int) strtol(++digits, &end, 16);
+    else if(buffer[0] == '%')
+        result = (int) strtol(++digits, &end, 2);
+    else
+        result = (int) strtol(digits, &end, 0);
+    
+    if(end == digits  ||  *end != '\0')
+        return false;
+    
+    return !maxValue  ||  result <= maxValue;
+}
+
+
+//
+// the front end as it was before the mapped input path: getline into a
+// fresh std::string per line, then tokenize
+//
+
+size_t readWithGetline(const std::string& filename)
+{
+    Context context;
+    std::ifstream file(filename);
+    std::string line;
+    size_t tokens = 0;
+    
+    while(getline(file, line))
+    {
+        split(context, line, context.tokens);
+        tokens += context.tokens.size();
+    }
+    
+    return tokens;
+}
+
+
+//
+//
+//
+
+size_t readWithMapping(const std::string& filename)
+{
+    Context context;
+    SourceFile source;
+    size_t tokens = 0;
+    
+    openSource(filename, source);
+    
+    for(std::string_view text = source.text(); !text.empty(); )
+    {
+        size_t newline = text.find('\n');
+        
+        split(context, text.substr(0, newline), context.tokens);
+        tokens += context.tokens.size();
+        
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+    }
+    
+    return tokens;
+}
+
+
+// a busy loop with the mix of a game's inner loop: arithmetic, tests,
+// a subroutine, a sprite and the timer, and never an end
+const char g_interpreterSource[] =
+    "        .org $200\n"
+    "        ld i, sprite\n"
+    "loop:   add v0, 1\n"
+    "        ld v2, v0\n"
+    "        and v2, v1\n"
+    "        xor v3, v0\n"
+    "        se v0, 0\n"
+    "        jp next\n"
+    "        add v1, 1\n"
+    "next:   call update\n"
+    "        drw v0, v1, 5\n"
+    "        rnd v4, $ff\n"
+    "        shr v4\n"
+    "        sne v4, v5\n"
+    "        ld v5, v4\n"
+    "        sub v5, v3\n"
+    "        ld v6, dt\n"
+    "        jp loop\n"
+    "update: add v7, 2\n"
+    "        ld v8, v7\n"
+    "        or v8, v0\n"
+    "        ret\n"
+    "sprite: .byte $f0, $90, $90, $90, $f0\n";
+
+
+//
+// the interpreter as emulators usually write it, for comparison: fetch and
+// decode every instruction through a switch, and a byte per pixel
+//
+
+struct SwitchInterpreter
+{
+    uint8_t memory[0x1000] = {};
+    uint8_t screen[32][64] = {};
+    uint8_t v[16] = {};
+    uint16_t stack[16] = {};
+    uint16_t i = 0;
+    uint16_t pc = 0x200;
+    int depth = 0;
+    uint32_t random = 1;
+    
+    void run(uint64_t count)
+    {
+        for(; count > 0; --count)
+        {
+            uint16_t word = (memory[pc] << 8) | memory[(pc + 1) & 0xfff];
+            int x = (word >> 8) & 15;
+            int y = (word >> 4) & 15;
+            
+            pc = (pc + 2) & 0xfff;
+            
+            switch(word >> 12)
+            {
+                case 0x0:
+                    if(word == 0x00e0)
+                        memset(screen, 0, sizeof(screen));
+                    else if(word == 0x00ee)
+                        pc = stack[--depth & 15];
+                    break;
+                
+                case 0x1:  pc = word & 0xfff;  break;
+                case 0x2:  stack[depth++ & 15] = pc;  pc = word & 0xfff;  break;
+                case 0x3:  pc += v[x] == (word & 0xff) ? 2 : 0;  break;
+                case 0x4:  pc += v[x] != (word & 0xff) ? 2 : 0;  break;
+                case 0x5:  pc += v[x] == v[y] ? 2 : 0;  break;
+                case 0x6:  v[x] = word;  break;
+                case 0x7:  v[x] += word;  break;
+                
+                case 0x8:
+                {
+                    uint8_t flag = 0;
+                    
+                    switch(word & 15)
+                    {
+                        case 0x0:  v[x] = v[y];  break;
+                        case 0x1:  v[x] |= v[y];  break;
+                        case 0x2:  v[x] &= v[y];  break;
+                        case 0x3:  v[x] ^= v[y];  break;
+                        case 0x4:  flag = v[x] + v[y] > 0xff;  v[x] += v[y];  v[15] = flag;  break;
+                        case 0x5:  flag = v[x] >= v[y];  v[x] -= v[y];  v[15] = flag;  break;
+                        case 0x6:  flag = v[x] & 1;  v[x] >>= 1;  v[15] = flag;  break;
+                        case 0x7:  flag = v[y] >= v[x];  v[x] = v[y] - v[x];  v[15] = flag;  break;
+                        case 0xe:  flag = v[x] >> 7;  v[x] <<= 1;  v[15] = flag;  break;
+                    }
+                    break;
+                }
+                
+                case 0x9:  pc += v[x] != v[y] ? 2 : 0;  break;
+                case 0xa:  i = word & 0xfff;  break;
+                case 0xb:  pc = (v[0] + (word & 0xfff)) & 0xfff;  break;
+                
+                case 0xc:
+                    random ^= random << 13;
+                    random ^= random >> 17;
+                    random ^= random << 5;
+                    v[x] = random & word;
+                    break;
+                
+                case 0xd:
+                    v[15] = 0;
+                    
+                    for(int row = 0; row < (word & 15); ++row)
+                    {
+                        for(int column = 0; column < 8; ++column)
+                        {
+                            int px = (v[x] + column) & 63;
+                            int py = (v[y] + row) & 31;
+                            
+                            if(memory[(i + row) & 0xfff] & (0x80 >> column))
+                            {
+                                v[15] |= screen[py][px];
+                                screen[py][px] ^= 1;
+                            }
+                        }
+                    }
+                    break;
+                
+                case 0xf:
+                    if((word & 0xff) == 0x07)
+                        v[x] = 0;
+                    break;
+            }
+            
+            pc &= 0xfff;
+        }
+    }
+};
+
+
+#ifdef CHIP8ASM_POSIX
+
+
+//
+// runs the command line tool and waits for it; the pid is returned so a
+// server can be stopped again
+//
+
+pid_t spawn(const std::vector<const char *>& arguments, bool wait)
+{
+    std::vector<char *> argv;
+    pid_t pid;
+    
+    for(const char *argument : arguments)
+        argv.push_back((char *) argument);
+    
+    argv.push_back(nullptr);
+    
+    if(posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+        return -1;
+    
+    int status;
+    
+    if(wait  &&  (waitpid(pid, &status, 0) != pid  ||  !WIFEXITED(status)  ||  WEXITSTATUS(status) != 0))
+        return -1;
+    
+    return pid;
+}
+
+
+//
+// a rom-sized source assembled by a warm server, against a fresh process
+// per file
+//
+
+void benchmarkServer(const std::string& binary)
+{
+    if(access(binary.c_str(), X_OK) != 0)
+    {
+        fprintf(stderr, "skipping server benchmarks, \"%s\" not found (--chip8asm)\n", binary.c_str());
+        return;
+    }
+    
+    GeneratorOptions generatorOptions;
+    generatorOptions.lines = 500;
+    
+    std::string source = generateSource(generatorOptions);
+    std::string filename = "chip8asm_bench_small.s";
+    std::string socketPath = "chip8asm_bench.sock";
+    FILE *file = fopen(filename.c_str(), "wb");
+    
+    if(!file)
+        return;
+    
+    fwrite(source.data(), 1, source.size(), file);
+    fclose(file);
+    
+    pid_t server = spawn({ binary.c_str(), "--serve", socketPath.c_str() }, false);
+    ServerConnection connection;
+    
+    for(int attempt = 0; server != -1  &&  attempt < 200  &&  !connection.connect(socketPath); ++attempt)
+        usleep(10000);
+    
+    Options options;
+    Result result;
+    
+    runBenchmark("assemble (server)", generatorOptions.lines, "lines", source.size(), [&]
+    {
+        if(!connection.assemble(options, source, result)  ||  !result.success)
+        {
+            fprintf(stderr, "server request failed\n");
+            exit(1);
+        }
+        
+        g_sink += result.image.size();
+    });
+    
+    runBenchmark("assemble (server, connect + path)", generatorOptions.lines, "lines", source.size(), [&]
+    {
+        ServerConnection perRequest;
+        
+        if(!perRequest.connect(socketPath)  ||  !perRequest.assembleFile(options, filename, result)  ||  !result.success)
+        {
+            fprintf(stderr, "server request failed\n");
+            exit(1);
+        }
+        
+        g_sink += result.image.size();
+    });
+    
+    runBenchmark("assemble (spawn process)", generatorOptions.lines, "lines", source.size(), [&]
+    {
+        if(spawn({ binary.c_str(), filename.c_str() }, true) == -1)
+        {
+            fprintf(stderr, "running \"%s\" failed\n", binary.c_str());
+            exit(1);
+        }
+    });
+    
+    if(server != -1)
+    {
+        kill(server, SIGTERM);
+        waitpid(server, nullptr, 0);
+    }
+    
+    remove(filename.c_str());
+    remove("chip8asm_bench_small.ch8");
+    remove(socketPath.c_str());
+}
+
+
+#endif
+
+
+//
+//
+//
+
+void usage()
+{
+    fprintf(stderr, "\nusage:  chip8asm_bench [--lines n] [--seed n] [--time seconds] [--filter text] [--generate file] [--chip8asm path]\n");
+    exit(1);
+}
+
+
+//
+//
+//
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions generatorOptions;
+    const char *generateFilename = nullptr;
+    
+    // the command line tool is expected next to the benchmark
+    std::string binary = argv[0];
+    binary = binary.substr(0, binary.rfind('/') + 1) + "chip8asm";
+    
+    for(int argument = 1; argument < argc; ++argument)
+    {
+        const char *value = argument + 1 < argc ? argv[argument + 1] : nullptr;
+        
+        if(!value)
+            usage();
+        else if(strcmp(argv[argument], "--lines") == 0)
+            generatorOptions.lines = strtoul(value, nullptr, 0);
+        else if(strcmp(argv[argument], "--seed") == 0)
+            generatorOptions.seed = strtoul(value, nullptr, 0);
+        else if(strcmp(argv[argument], "--time") == 0)
+            g_minimumTime = atof(value);
+        else if(strcmp(argv[argument], "--filter") == 0)
+            g_filter = value;
+        else if(strcmp(argv[argument], "--generate") == 0)
+            generateFilename = value;
+        else if(strcmp(argv[argument], "--chip8asm") == 0)
+            binary = value;
+        else
+            usage();
+        
+        ++argument;
+    }
+    
+    std::string source = generateSource(generatorOptions);
+    std::vector<std::string_view> lines = splitLines(source);
+    
+    
+    // with --generate we only write the source, for benchmarking the
+    // command line tool itself
+    if(generateFilename)
+    {
+        FILE *file = fopen(generateFilename, "wb");
+        
+        if(!file  ||  fwrite(source.data(), 1, source.size(), file) != source.size()  ||  fclose(file) != 0)
+        {
+            fprintf(stderr, "error writing \"%s\"\n", generateFilename);
+            return 1;
+        }
+        
+        return 0;
+    }
+    
+    printf("generated source: %zu lines, %zu bytes\n\n", lines.size(), source.size());
+    
+    
+    // gather the operands the micro benchmarks feed to the parsers
+    Context context;
+    std::vector<std::string> operands;
+    std::vector<std::string> integers;
+    std::vector<std::string> labels;
+    size_t tokenCount = 0;
+    
+    for(std::string_view line : lines)
+    {
+        split(context, line, context.tokens);
+        tokenCount += context.tokens.size();
+        
+        for(int index = 0; index < context.tokens.size(); ++index)
+        {
+            std::string_view text = context.tokens[index].text;
+            int value;
+            
+            if(text.back() == ':')
+                labels.emplace_back(text.substr(0, text.size() - 1));
+            else if(index > 0)
+                operands.emplace_back(context.tokens[index].lower);
+            
+            if(index > 0  &&  parseInteger(text, value))
+                integers.emplace_back(text);
+        }
+    }
+    
+    
+    // micro benchmarks
+    runBenchmark("tokenize", lines.size(), "lines", source.size(), [&]
+    {
+        size_t count = 0;
+        
+        for(std::string_view line : lines)
+        {
+            split(context, line, context.tokens);
+            count += context.tokens.size();
+        }
+        
+        g_sink += count;
+    });
+    
+    std::vector<const ScanKernels *> kernels = { &g_scalarKernels };
+#ifdef CHIP8ASM_X86_SIMD
+    kernels.push_back(&g_sse2Kernels);
+    
+    if(&scanKernels() == &g_avx2Kernels)
+        kernels.push_back(&g_avx2Kernels);
+#endif
+    
+    for(const ScanKernels *kernel : kernels)
+    {
+        std::string name = std::string("classify + lower (") + kernel->name + ")";
+        std::string lowered(source.size(), '\0');
+        
+        runBenchmark(name.c_str(), source.size() / SCAN_BLOCK_SIZE, "blocks", source.size(), [&]
+        {
+            ScanMasks masks;
+            uint64_t sum = 0;
+            
+            for(size_t base = 0; base + SCAN_BLOCK_SIZE <= source.size(); base += SCAN_BLOCK_SIZE)
+            {
+                kernel->classify(source.data() + base, masks);
+                sum += masks.delimiters ^ masks.colons ^ masks.semicolons;
+            }
+            
+            kernel->lower(source.data(), &lowered[0], source.size());
+            g_sink += sum + lowered[source.size() / 2];
+        });
+    }
+    
+    runBenchmark("parseRegister", operands.size(), "operands", 0, [&]
+    {
+        int sum = 0;
+        int reg;
+        
+        for(const std::string& operand : operands)
+            sum += parseRegister(operand, reg) ? reg : 0;
+        
+        g_sink += sum;
+    });
+    
+    runBenchmark("parseInteger", integers.size(), "integers", 0, [&]
+    {
+        int sum = 0;
+        int value;
+        
+        for(const std::string& integer : integers)
+            sum += parseInteger(integer, value, 0xffff) ? value : 0;
+        
+        g_sink += sum;
+    });
+    
+    runBenchmark("parseInteger (strtol)", integers.size(), "integers", 0, [&]
+    {
+        int sum = 0;
+        int value;
+        
+        for(const std::string& integer : integers)
+            sum += parseIntegerStrtol(integer, value, 0xffff) ? value : 0;
+        
+        g_sink += sum;
+    });
+    
+    SymbolTable symbols;
+    
+    for(const std::string& label : labels)
+        symbols.intern(label);
+    
+    runBenchmark("symbol lookup", labels.size(), "lookups", 0, [&]
+    {
+        uint32_t sum = 0;
+        
+        for(const std::string& label : labels)
+            sum += symbols.intern(label);
+        
+        g_sink += sum;
+    });
+    
+    Context parsed;
+    parseSource(parsed, source);
+    resolveSymbols(parsed);
+    
+    runBenchmark("encode", parsed.statements.size(), "statements", 0, [&]
+    {
+        Arena arena;
+        RomImage image(arena);
+        
+        encodeStatements(parsed, image);
+        g_sink += image.highest;
+    });
+    
+    runBenchmark("parse (serial)", lines.size(), "lines", source.size(), [&]
+    {
+        Context context;
+        
+        parseSource(context, source);
+        g_sink += context.statements.size();
+    });
+    
+    runBenchmark("parse (parallel)", lines.size(), "lines", source.size(), [&]
+    {
+        Context context;
+        
+        parseSourceParallel(context, source, 0);
+        g_sink += context.statements.size();
+    });
+    
+    
+    // input backends, reading the generated source back from a file
+    std::string filename = "chip8asm_bench.s";
+    FILE *file = fopen(filename.c_str(), "wb");
+    
+    if(file)
+    {
+        fwrite(source.data(), 1, source.size(), file);
+        fclose(file);
+        
+        runBenchmark("read + tokenize (getline)", lines.size(), "lines", source.size(), [&]
+        {
+            g_sink += readWithGetline(filename);
+        });
+        
+        runBenchmark("read + tokenize (mapped)", lines.size(), "lines", source.size(), [&]
+        {
+            g_sink += readWithMapping(filename);
+        });
+        
+        remove(filename.c_str());
+    }
+    
+    
+    // macro benchmark: the whole assembler, source text to rom image, with
+    // the statement list and with everything emitted during the parse
+    Options singlePassOptions;
+    singlePassOptions.singlePass = true;
+    
+    for(const Assembler& assembler : { Assembler(), Assembler(singlePassOptions) })
+    {
+        runBenchmark(assembler.options().singlePass ? "assemble (single pass)" : "assemble", lines.size(), "lines", source.size(), [&]
+        {
+            Result result = assembler.assemble(source);
+            
+            if(!result.success)
+            {
+                fprintf(stderr, "generated source failed to assemble: %s\n", result.diagnostics[0].message.c_str());
+                exit(1);
+            }
+            
+            g_sink += result.image.size();
+        });
+    }
+    
+    
+    // the same program with its operands written as expressions over .equ
+    // constants and labels: what folding and resolving them costs
+    GeneratorOptions expressionOptions = generatorOptions;
+    expressionOptions.expressions = true;
+    
+    std::string expressionSource = generateSource(expressionOptions);
+    
+    for(const Assembler& assembler : { Assembler(), Assembler(singlePassOptions) })
+    {
+        runBenchmark(assembler.options().singlePass ? "assemble (expressions, single pass)" : "assemble (expressions)", lines.size(), "lines", expressionSource.size(), [&]
+        {
+            Result result = assembler.assemble(expressionSource);
+            
+            if(!result.success)
+            {
+                fprintf(stderr, "generated source failed to assemble: %s\n", result.diagnostics[0].message.c_str());
+                exit(1);
+            }
+            
+            g_sink += result.image.size();
+        });
+    }
+    
+    
+    // the built-in interpreter running an assembled loop, in millions of
+    // chip-8 instructions a second, against one that decodes as it goes
+    Result program = Assembler().assemble(g_interpreterSource);
+    const uint64_t INTERPRETED_INSTRUCTIONS = 10000000;
+    
+    Interpreter interpreter;
+    interpreter.load(program.image, program.origin);
+    
+    runBenchmark("interpret (threaded)", INTERPRETED_INSTRUCTIONS, "instructions", 0, [&]
+    {
+        g_sink += interpreter.run(INTERPRETED_INSTRUCTIONS);
+    });
+    
+    SwitchInterpreter switchInterpreter;
+    memcpy(switchInterpreter.memory + program.origin, program.image.data(), program.image.size());
+    
+    runBenchmark("interpret (switch)", INTERPRETED_INSTRUCTIONS, "instructions", 0, [&]
+    {
+        switchInterpreter.run(INTERPRETED_INSTRUCTIONS);
+        g_sink += switchInterpreter.v[0];
+    });
+    
+    
+    // latency of a small assembly through the server and the command line
+#ifdef CHIP8ASM_POSIX
+    if(!g_filter  ||  strstr("assemble (server) assemble (spawn process)", g_filter))
+        benchmarkServer(binary);
+#endif
+    
+    return 0;
+}
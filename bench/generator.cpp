@@ -0,0 +1,268 @@
+#include "generator.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+
+//
+//
+//
+
+namespace
+{
+
+// bytes of code space we leave for the code section and its sprite tables
+constexpr int CODE_END = 0x1000;
+constexpr int DATA_END = 0x10000;
+
+const char *g_comments[] =
+{
+    "update position",
+    "wait for the delay timer",
+    "draw the next frame",
+    "check for collision",
+    "advance the counter",
+    "load sprite address"
+};
+
+
+struct Generator
+{
+    const GeneratorOptions& options;
+    std::mt19937 random;
+    std::string source;
+    
+    int address = 0x200;
+    int labelCount = 0;
+    int spriteCount = 0;
+    size_t lines = 0;
+    
+    explicit Generator(const GeneratorOptions& options)
+        : options(options), random(options.seed)
+    {
+    }
+    
+    int pick(int count)
+    {
+        return std::uniform_int_distribution<int>(0, count - 1)(random);
+    }
+    
+    void line(const char *label, const char *text)
+    {
+        size_t labelLength = strlen(label);
+        
+        // the label left aligned in a 14 column field, as "%-14s" would
+        source += label;
+        source.append(labelLength < 14 ? 14 - labelLength : 0, ' ');
+        source += "  ";
+        source += text;
+        
+        if(pick(100) < options.commentPercent)
+        {
+            source += "   ; ";
+            source += g_comments[pick(sizeof(g_comments) / sizeof(g_comments[0]))];
+        }
+        
+        source += '\n';
+        ++lines;
+    }
+};
+
+
+const char *g_registers[] =
+{
+    "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7",
+    "v8", "v9", "va", "vb", "vc", "vd", "ve", "vf"
+};
+
+
+// constants the expression-heavy source is written over
+constexpr int BASE = 16;
+constexpr int HEIGHT = 15;
+
+const char *g_constants[] =
+{
+    ".equ BASE, 16",
+    ".equ HEIGHT, 15",
+    ".equ MASK, $f0",
+    ".equ STRIDE, BASE * 4"
+};
+
+
+// forward references point at labels that will exist once the code section
+// is finished, so every generated source assembles
+void emitInstruction(Generator& generator, int plannedLabels)
+{
+    char text[64];
+    const char *x = g_registers[generator.pick(15)];
+    const char *y = g_registers[generator.pick(15)];
+    int target = generator.pick(plannedLabels);
+    
+    // the same mix of instructions, with the operands that can be written
+    // as expressions written as them
+    if(generator.options.expressions)
+    {
+        int sprite = generator.pick(std::max(generator.spriteCount, 1));
+        
+        switch(generator.pick(20))
+        {
+            case 0:   snprintf(text, sizeof(text), "jp loop%d", target);  break;
+            case 1:   snprintf(text, sizeof(text), "call loop%d", target);  break;
+            case 2:   snprintf(text, sizeof(text), "ld i, sprite%d + %d", sprite, generator.pick(4));  break;
+            case 3:   snprintf(text, sizeof(text), "drw %s, %s, HEIGHT - %d", x, y, generator.pick(HEIGHT));  break;
+            case 4:   snprintf(text, sizeof(text), "ld %s, BASE + $%02x", x, generator.pick(256 - BASE));  break;
+            case 5:   snprintf(text, sizeof(text), "ld %s, lo(loop%d)", x, target);  break;
+            case 6:   snprintf(text, sizeof(text), "add %s, -%d", x, 1 + generator.pick(128));  break;
+            case 7:   snprintf(text, sizeof(text), "add %s, %s", x, y);  break;
+            case 8:   snprintf(text, sizeof(text), "se %s, MASK | %d", x, generator.pick(16));  break;
+            case 9:   snprintf(text, sizeof(text), "sne %s, (STRIDE * %d) & $ff", x, generator.pick(16));  break;
+            case 10:  snprintf(text, sizeof(text), "xor %s, %s", x, y);  break;
+            case 11:  snprintf(text, sizeof(text), "ld %s, hi(sprite%d)", x, sprite);  break;
+            case 12:  snprintf(text, sizeof(text), "ld %s, dt", x);  break;
+            case 13:  snprintf(text, sizeof(text), "ld dt, %s", x);  break;
+            case 14:  snprintf(text, sizeof(text), "skp %s", x);  break;
+            case 15:  snprintf(text, sizeof(text), "shr %s", x);  break;
+            case 16:  snprintf(text, sizeof(text), "rnd %s, (1 << %d) - 1", x, 1 + generator.pick(8));  break;
+            case 17:  snprintf(text, sizeof(text), "LD %s, [I]", x);  break;
+            case 18:  snprintf(text, sizeof(text), "add i, %s", x);  break;
+            default:  snprintf(text, sizeof(text), "cls");  break;
+        }
+        
+        generator.line("", text);
+        generator.address += 2;
+        return;
+    }
+    
+    switch(generator.pick(20))
+    {
+        case 0:   snprintf(text, sizeof(text), "jp loop%d", target);  break;
+        case 1:   snprintf(text, sizeof(text), "call loop%d", target);  break;
+        case 2:   snprintf(text, sizeof(text), "ld i, sprite%d", generator.pick(std::max(generator.spriteCount, 1)));  break;
+        case 3:   snprintf(text, sizeof(text), "drw %s, %s, %d", x, y, 1 + generator.pick(15));  break;
+        case 4:   snprintf(text, sizeof(text), "ld %s, $%02x", x, generator.pick(256));  break;
+        case 5:   snprintf(text, sizeof(text), "ld %s, %d", x, generator.pick(256));  break;
+        case 6:   snprintf(text, sizeof(text), "add %s, %d", x, generator.pick(256));  break;
+        case 7:   snprintf(text, sizeof(text), "add %s, %s", x, y);  break;
+        case 8:   snprintf(text, sizeof(text), "se %s, %%%d%d%d%d0101", x, generator.pick(2), generator.pick(2), generator.pick(2), generator.pick(2));  break;
+        case 9:   snprintf(text, sizeof(text), "sne %s, %s", x, y);  break;
+        case 10:  snprintf(text, sizeof(text), "xor %s, %s", x, y);  break;
+        case 11:  snprintf(text, sizeof(text), "and %s, %s", x, y);  break;
+        case 12:  snprintf(text, sizeof(text), "ld %s, dt", x);  break;
+        case 13:  snprintf(text, sizeof(text), "ld dt, %s", x);  break;
+        case 14:  snprintf(text, sizeof(text), "skp %s", x);  break;
+        case 15:  snprintf(text, sizeof(text), "shr %s", x);  break;
+        case 16:  snprintf(text, sizeof(text), "rnd %s, $ff", x);  break;
+        case 17:  snprintf(text, sizeof(text), "LD %s, [I]", x);  break;
+        case 18:  snprintf(text, sizeof(text), "add i, %s", x);  break;
+        default:  snprintf(text, sizeof(text), "cls");  break;
+    }
+    
+    generator.line("", text);
+    generator.address += 2;
+}
+
+}  // namespace
+
+
+//
+//
+//
+
+std::string generateSource(const GeneratorOptions& options)
+{
+    Generator generator(options);
+    generator.source.reserve(options.lines * 32);
+    
+    
+    // code section: labelled blocks of instructions with an occasional sprite
+    // table, all below $1000 so 12-bit references reach them
+    int plannedLabels = std::max<int>(1, std::min<size_t>(options.lines / 10, 300));
+    
+    if(options.expressions)
+    {
+        for(const char *constant : g_constants)
+            generator.line("", constant);
+    }
+    
+    generator.line("", ".org $200");
+    
+    while(generator.labelCount < plannedLabels)
+    {
+        char label[32];
+        
+        snprintf(label, sizeof(label), "loop%d:", generator.labelCount++);
+        generator.line(label, "cls");
+        generator.address += 2;
+        
+        for(int count = generator.pick(8); count > 0; --count)
+            emitInstruction(generator, plannedLabels);
+        
+        if(generator.pick(6) == 0  &&  generator.address < CODE_END - 16)
+        {
+            char text[64];
+            
+            snprintf(label, sizeof(label), "sprite%d:", generator.spriteCount++);
+            snprintf(text, sizeof(text), ".byte %%11110000, %%10010000, $%02x, $%02x", generator.pick(256), generator.pick(256));
+            generator.line(label, text);
+            generator.address += 4;
+        }
+        
+        // leave room for the remaining labels and the trailing instructions
+        if(generator.address > CODE_END - 48)
+        {
+            while(generator.labelCount < plannedLabels)
+            {
+                snprintf(label, sizeof(label), "loop%d:", generator.labelCount++);
+                generator.line(label, "ret");
+                generator.address += 2;
+            }
+        }
+    }
+    
+    if(generator.spriteCount == 0)
+    {
+        generator.line("sprite0:", ".byte $f0, $90, $90, $f0");
+        generator.address += 4;
+    }
+    
+    
+    // data section: large lookup tables filling the rest of the request
+    generator.line("", ".org $1000");
+    generator.address = 0x1000;
+    
+    while(generator.lines < options.lines  &&  generator.address + 16 <= DATA_END)
+    {
+        char text[128];
+        
+        // tables of addresses need the labels, the rest fold to plain data
+        if(options.expressions  &&  generator.pick(4) == 0)
+        {
+            int loop = generator.pick(plannedLabels);
+            
+            snprintf(text, sizeof(text), ".word loop%d, loop%d + 2, sprite0 + BASE, $%04x",
+                loop, loop, generator.pick(0x10000));
+        }
+        else if(options.expressions)
+        {
+            snprintf(text, sizeof(text), ".byte lo(BASE * %d), MASK >> 4, %d + BASE, $%02x & MASK, -%d, STRIDE / 2, %d, %d",
+                generator.pick(16), generator.pick(200), generator.pick(256), 1 + generator.pick(128), generator.pick(256), generator.pick(256));
+        }
+        else if(generator.pick(4) == 0)
+        {
+            snprintf(text, sizeof(text), ".word $%04x, $%04x, $%04x, $%04x",
+                generator.pick(0x10000), generator.pick(0x10000), generator.pick(0x10000), generator.pick(0x10000));
+        }
+        else
+        {
+            snprintf(text, sizeof(text), ".byte $%02x, $%02x, %d, %d, $%02x, $%02x, %d, %d",
+                generator.pick(256), generator.pick(256), generator.pick(256), generator.pick(256),
+                generator.pick(256), generator.pick(256), generator.pick(256), generator.pick(256));
+        }
+        
+        generator.line("", text);
+        generator.address += 8;
+    }
+    
+    return std::move(generator.source);
+}
@@ -0,0 +1,26 @@
+#ifndef CHIP8ASM_BENCH_GENERATOR_H
+#define CHIP8ASM_BENCH_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+struct GeneratorOptions
+{
+    size_t lines = 10000;        // approximate number of source lines
+    uint32_t seed = 1;
+    int commentPercent = 25;     // chance that a line carries a comment
+    bool expressions = false;    // write operands as expressions over .equ
+                                 // constants and labels where they fit
+};
+
+
+// emits a realistic chip-8 source: code with labels, backward and forward
+// references and small sprite tables below $1000, followed by large .byte
+// and .word data tables; output stays inside the 64 KiB address space, so
+// very large requests are capped there
+std::string generateSource(const GeneratorOptions& options);
+
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CHIP8ASM_H
+#define CHIP8ASM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace chip8asm
+{
+
+
+struct Options
+{
+    uint8_t fill = 0;        // value of bytes in gaps between .org blocks
+    int threads = 1;         // threads used to parse large sources, 0 means one per core
+    bool profile = false;    // time each phase into Result::stats
+    bool singlePass = false; // encode while parsing, patching forward references; ignores threads
+    std::string includeDirectory;   // relative .incbin paths start here, or in the working directory when empty
+};
+
+
+struct Diagnostic
+{
+    int line;                // 0 when the problem is not tied to a line
+    int column;              // -1 when the problem is not tied to a column
+    std::string message;
+};
+
+
+struct Statistics
+{
+    size_t lines = 0;
+    size_t tokens = 0;
+    size_t statements = 0;
+    size_t symbols = 0;
+    size_t bytes = 0;        // bytes emitted into the image
+    
+    // wall time of each phase in seconds; the first three take a clock read
+    // per line, so they are only measured with Options::profile, and a parse
+    // split across threads reports the sum over its threads
+    double tokenizeTime = 0;
+    double parseTime = 0;    // parsing that is not tokenizing or defining labels
+    double defineTime = 0;
+    double resolveTime = 0;
+    double emitTime = 0;
+};
+
+
+struct Result
+{
+    bool success = false;
+    uint16_t origin = 0;     // address of the first byte in image
+    std::vector<uint8_t> image;
+    std::vector<Diagnostic> diagnostics;
+    Statistics stats;
+};
+
+
+// assembles chip-8 source held in memory; every call keeps its state in its
+// own context, so one assembler may be used from several threads at once
+class Assembler
+{
+public:
+    explicit Assembler(const Options& options = Options());
+    
+    const Options& options() const  { return m_options; }
+    
+    Result assemble(std::string_view source) const;
+
+private:
+    Options m_options;
+};
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,632 @@
+#ifndef CHIP8ASM_COMPILETIME_H
+#define CHIP8ASM_COMPILETIME_H
+
+// assembles chip-8 source inside the compiler, for roms embedded in c++:
+//
+//     constexpr auto rom = chip8asm::assemble<"start: ld v0, 1\n  jp start\n">();
+//
+// rom is a std::array<uint8_t, N> holding the same bytes as Result::image,
+// and chip8asm::imageOrigin<...>() gives the address of its first byte. a
+// source that does not assemble stops the compile; the error trace names
+// the problem and the line it is on. this needs c++20, the library itself
+// does not.
+
+#include <version>
+
+#if !defined(__cpp_consteval)  ||  __cpp_nontype_template_args < 201911L  ||  \
+    !defined(__cpp_lib_constexpr_vector)  ||  !defined(__cpp_lib_constexpr_string)
+#error "compiletime.h needs c++20: consteval, class type template arguments, constexpr vector and string"
+#else
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "expression.h"
+#include "instructions.h"
+#include "operands.h"
+#include "tokenizer.h"
+
+
+namespace chip8asm
+{
+
+
+// a string literal as a template argument
+template<size_t Size>
+struct SourceLiteral
+{
+    char text[Size];
+    
+    constexpr SourceLiteral(const char (&literal)[Size])
+    {
+        for(size_t index = 0; index < Size; ++index)
+            text[index] = literal[index];
+    }
+    
+    constexpr std::string_view view() const  { return std::string_view(text, Size - 1); }
+};
+
+
+namespace compiletime
+{
+
+
+// indexing past this is what turns an assembly error into a compile error;
+// the compiler reports the index, which is the source line
+inline constexpr bool assembly_error_on_line[1] = {};
+
+
+// what assembleSource() throws when it runs outside the compiler, as it
+// does in the tests that hold it to the runtime assembler
+struct AssemblyError
+{
+    const char *message;
+    int line;
+};
+
+
+// the trace of the compile error shows message and line; errors that are
+// not tied to a line stop at the throw instead
+constexpr void fail(const char *message, int line)
+{
+    if(!std::is_constant_evaluated())
+        throw AssemblyError{ message, line };
+    
+    if(!assembly_error_on_line[line])
+        throw message;
+}
+
+
+struct Label
+{
+    std::string_view name;   // lowercase
+    int value;               // -1 until defined
+    int line;                // first reference, for errors
+    bool constant;           // defined by .equ
+};
+
+
+// the compiler charges for every step it evaluates, so the loops below walk
+// raw pointers and labels are hashed rather than searched
+struct Assembly
+{
+    std::vector<Statement> statements;
+    std::vector<int> statementLines;
+    std::vector<Label> labels;
+    std::vector<uint32_t> buckets;   // label index + 1, 0 when empty
+    std::vector<Token> tokens;
+    std::vector<Expression> expressions;
+    std::vector<ExpressionTerm> terms;
+    std::vector<Constant> constants;
+    ExpressionTerm scratchTerms[MAX_EXPRESSION_TERMS] = {};
+    int lineNumber = 0;
+    int offset = 0x0200;     // up to $10000
+};
+
+
+//
+//
+//
+
+constexpr uint32_t hashName(std::string_view name)
+{
+    const char *text = name.data();
+    uint32_t hash = 2166136261u;
+    
+    for(size_t index = 0; index < name.size(); ++index)
+        hash = (hash ^ (uint8_t) text[index]) * 16777619u;
+    
+    return hash;
+}
+
+
+//
+// the label's index, adding it when it is new
+//
+
+constexpr uint32_t findLabel(Assembly& assembly, std::string_view name)
+{
+    // keep the table at most half full
+    if(assembly.buckets.size() < assembly.labels.size() * 2 + 2)
+    {
+        assembly.buckets.assign(assembly.buckets.empty() ? 256 : assembly.buckets.size() * 2, 0);
+        
+        for(uint32_t index = 0; index < assembly.labels.size(); ++index)
+        {
+            size_t bucket = hashName(assembly.labels[index].name) & (assembly.buckets.size() - 1);
+            
+            while(assembly.buckets[bucket])
+                bucket = (bucket + 1) & (assembly.buckets.size() - 1);
+            
+            assembly.buckets[bucket] = index + 1;
+        }
+    }
+    
+    size_t bucket = hashName(name) & (assembly.buckets.size() - 1);
+    
+    for(; assembly.buckets[bucket]; bucket = (bucket + 1) & (assembly.buckets.size() - 1))
+    {
+        if(assembly.labels[assembly.buckets[bucket] - 1].name == name)
+            return assembly.buckets[bucket] - 1;
+    }
+    
+    assembly.labels.push_back({ name, -1, 0, false });
+    assembly.buckets[bucket] = assembly.labels.size();
+    return assembly.labels.size() - 1;
+}
+
+
+//
+//
+//
+
+constexpr void addToken(Assembly& assembly, const char *text, const char *lower, int start, int end)
+{
+    if(assembly.tokens.size() == MAX_TOKENS)
+        fail("too many tokens", assembly.lineNumber);
+    
+    assembly.tokens.push_back({ start, std::string_view(text + start, end - start), std::string_view(lower + start, end - start), TOKEN_SYMBOL, 0 });
+    classifyToken(assembly.tokens.back());
+}
+
+
+//
+// tokenizes the line at text with the same boundaries as split(): whitespace
+// and commas separate tokens, a colon ends a label and stays on it, and a
+// semicolon starts a comment; returns the length of the line
+//
+
+constexpr size_t splitLine(Assembly& assembly, const char *text, char *lower, size_t available)
+{
+    assembly.tokens.clear();
+    
+    size_t position = 0;
+    int start = -1;
+    
+    for(; position < available  &&  text[position] != '\n'  &&  text[position] != ';'; ++position)
+    {
+        char c = text[position];
+        bool delimiter = c == ' '  ||  c == ','  ||  (c >= '\t'  &&  c <= '\r');
+        
+        lower[position] = toLowerAscii(c);
+        
+        if(start == -1)
+        {
+            if(c == ':')
+                fail("label name must preceed colon", assembly.lineNumber);
+            
+            if(!delimiter)
+                start = position;
+            
+            continue;
+        }
+        
+        if(!delimiter  &&  c != ':')
+            continue;
+        
+        addToken(assembly, text, lower, start, position + (c == ':'));
+        start = -1;
+    }
+    
+    if(start != -1)
+        addToken(assembly, text, lower, start, position);
+    
+    while(position < available  &&  text[position] != '\n')
+        ++position;
+    
+    return position;
+}
+
+
+//
+// the hooks operands.h parses operands through, like those of the same
+// names in assembler.cpp
+//
+
+constexpr uint32_t referenceLabel(Assembly& assembly, std::string_view name)
+{
+    uint32_t id = findLabel(assembly, name);
+    
+    if(assembly.labels[id].line == 0)
+        assembly.labels[id].line = assembly.lineNumber;
+    
+    return id;
+}
+
+
+//
+//
+//
+
+constexpr ExpressionResult foldTerms(const Assembly& assembly, const ExpressionTerm *terms, int count)
+{
+    return evaluateExpression(terms, count, [&assembly](uint32_t id, int& value)
+    {
+        value = assembly.labels[id].value;
+        return assembly.labels[id].constant;
+    });
+}
+
+
+//
+//
+//
+
+constexpr uint32_t storeExpression(Assembly& assembly, const ExpressionTerm *terms, int count)
+{
+    assembly.expressions.push_back({ (uint32_t) assembly.terms.size(), (uint32_t) count, assembly.lineNumber });
+    assembly.terms.insert(assembly.terms.end(), terms, terms + count);
+    
+    return STATEMENT_EXPRESSION | (uint32_t) (assembly.expressions.size() - 1);
+}
+
+
+//
+// places a statement at the offset, like fitsInMemory() and addStatement()
+//
+
+constexpr void addStatement(Assembly& assembly, Statement statement)
+{
+    if(assembly.offset + statementSize(statement) > 0x10000)
+        fail("statement extends past the end of memory", assembly.lineNumber);
+    
+    statement.offset = assembly.offset;
+    assembly.statements.push_back(statement);
+    assembly.statementLines.push_back(assembly.lineNumber);
+    assembly.offset += statementSize(statement);
+}
+
+
+//
+//
+//
+
+constexpr void parseData(Assembly& assembly, const Token *tokens, size_t count, int instruction)
+{
+    if(count < 2)
+        fail(instruction == INST_DEFINEBYTE ? "missing argument to '.byte'" : "missing argument to '.word'", assembly.lineNumber);
+    
+    for(size_t index = 1; index < count; ++index)
+    {
+        Statement statement = {};
+        statement.instruction = instruction;
+        
+        if(!parseValue(assembly, tokens[index], g_instructionEncodings.encodings[instruction].operandMask, statement.operand))
+            fail(instruction == INST_DEFINEBYTE ? "invalid argument to '.byte'" : "invalid argument to '.word'", assembly.lineNumber);
+        
+        addStatement(assembly, statement);
+    }
+}
+
+
+//
+// .fill count, value and .space count, one byte statement at a time
+//
+
+constexpr void parseFill(Assembly& assembly, const Token *tokens, size_t count, bool space)
+{
+    int size = 0;
+    int value = 0;
+    
+    if(count != (space ? 2 : 3)  ||  !parseConstant(assembly, tokens[1], 0x10000, size)  ||  (!space  &&  !parseConstant(assembly, tokens[2], 0xff, value)))
+        fail(space ? "missing, unexpected, or invalid argument(s) to '.space'" : "missing, unexpected, or invalid argument(s) to '.fill'", assembly.lineNumber);
+    
+    // checked once for the whole run rather than for each of its bytes
+    if(assembly.offset + size > 0x10000)
+        fail("statement extends past the end of memory", assembly.lineNumber);
+    
+    Statement statement = {};
+    statement.instruction = INST_DEFINEBYTE;
+    statement.operand = value;
+    
+    for(int index = 0; index < size; ++index)
+        addStatement(assembly, statement);
+}
+
+
+//
+// .equ name, value, like parseEquate()
+//
+
+constexpr void parseEquate(Assembly& assembly, const Token *tokens, size_t count)
+{
+    ExpressionTerm terms[MAX_EXPRESSION_TERMS] = {};
+    int termCount = 0;
+    
+    if(count != 3  ||  tokens[1].kind != TOKEN_SYMBOL  ||  !parseTerms(assembly, tokens[2], terms, termCount))
+        fail("missing, unexpected, or invalid argument(s) to '.equ'", assembly.lineNumber);
+    
+    uint32_t id = findLabel(assembly, tokens[1].lower);
+    
+    if(assembly.labels[id].value >= 0)
+        fail("constant is already defined", assembly.lineNumber);
+    
+    ExpressionResult result = foldTerms(assembly, terms, termCount);
+    
+    if(result.status == EXPRESSION_PENDING)
+    {
+        assembly.constants.push_back({ id, storeExpression(assembly, terms, termCount) & ~STATEMENT_EXPRESSION });
+        return;
+    }
+    
+    if(result.status == EXPRESSION_ERROR)
+        fail(result.error, assembly.lineNumber);
+    
+    if(result.value < 0  ||  result.value > 0xffff)
+        fail("constant is out of range", assembly.lineNumber);
+    
+    assembly.labels[id].value = result.value;
+    assembly.labels[id].constant = true;
+}
+
+
+//
+// tries each form of the mnemonic in table order, like parseInstruction()
+//
+
+constexpr void parseInstruction(Assembly& assembly, const Token *tokens, size_t count)
+{
+    int firstForm = 0;
+    int formCount = 0;
+    
+    while(firstForm < INSTRUCTION_FORM_COUNT  &&  g_instructionForms[firstForm].mnemonic != tokens[0].lower)
+        ++firstForm;
+    
+    while(firstForm + formCount < INSTRUCTION_FORM_COUNT  &&  g_instructionForms[firstForm + formCount].mnemonic == tokens[0].lower)
+        ++formCount;
+    
+    if(!formCount)
+        fail("unknown instruction", assembly.lineNumber);
+    
+    Statement statement = {};
+    
+    if(!matchForm(assembly, firstForm, formCount, tokens + 1, (int) count - 1, statement))
+        fail("missing, unexpected, or invalid argument(s)", assembly.lineNumber);
+    
+    addStatement(assembly, statement);
+}
+
+
+//
+// the whole assembler: parse, resolve labels, encode; returns the image from
+// its lowest address, filled like flattenImage()
+//
+
+constexpr std::vector<uint8_t> assembleSource(std::string_view source, uint8_t fill, int& origin)
+{
+    Assembly assembly;
+    std::string lowercase(source.size(), '\0');
+    
+    for(size_t cursor = 0; cursor < source.size(); )
+    {
+        ++assembly.lineNumber;
+        cursor += splitLine(assembly, source.data() + cursor, lowercase.data() + cursor, source.size() - cursor) + 1;
+        
+        Token *tokens = assembly.tokens.data();
+        size_t count = assembly.tokens.size();
+        
+        if(!count)
+            continue;
+        
+        if(tokens[0].text.back() == ':')
+        {
+            uint32_t id = findLabel(assembly, tokens[0].lower.substr(0, tokens[0].lower.size() - 1));
+            
+            if(assembly.labels[id].value >= 0)
+                fail("label is already defined", assembly.lineNumber);
+            
+            assembly.labels[id].value = assembly.offset;
+            
+            if(count < 2)
+                continue;
+            
+            ++tokens;
+            --count;
+        }
+        
+        count = joinExpressions(tokens, count);
+        
+        if(tokens[0].lower == ".org")
+        {
+            int origin = 0;
+            
+            if(count != 2  ||  !parseConstant(assembly, tokens[1], 0xffff, origin))
+                fail("missing, unexpected, or invalid argument(s) to '.org'", assembly.lineNumber);
+            
+            assembly.offset = origin;
+        }
+        else if(tokens[0].lower == ".equ")
+            parseEquate(assembly, tokens, count);
+        else if(tokens[0].lower == ".byte")
+            parseData(assembly, tokens, count, INST_DEFINEBYTE);
+        else if(tokens[0].lower == ".word")
+            parseData(assembly, tokens, count, INST_DEFINEWORD);
+        else if(tokens[0].lower == ".fill"  ||  tokens[0].lower == ".space")
+            parseFill(assembly, tokens, count, tokens[0].lower == ".space");
+        else if(tokens[0].lower == ".incbin")
+            fail("'.incbin' cannot read files at compile time", assembly.lineNumber);
+        else
+            parseInstruction(assembly, tokens, count);
+    }
+    
+    
+    // resolve constants, then labels and expressions, in the order and with
+    // the limits of resolveSymbols()
+    auto lookup = [&assembly](uint32_t id, int& value)
+    {
+        value = assembly.labels[id].value;
+        return value >= 0;
+    };
+    
+    for(const Constant& constant : assembly.constants)
+    {
+        const Expression& expression = assembly.expressions[constant.expression];
+        Label& label = assembly.labels[constant.symbol];
+        ExpressionResult result = evaluateExpression(assembly.terms.data() + expression.firstTerm, expression.termCount, lookup);
+        
+        if(label.value >= 0)
+            fail("constant is already defined", expression.line);
+        
+        if(result.status == EXPRESSION_PENDING)
+            fail("undefined symbol", assembly.labels[result.symbol].line);
+        
+        if(result.status == EXPRESSION_ERROR)
+            fail(result.error, expression.line);
+        
+        if(result.value < 0  ||  result.value > 0xffff)
+            fail("constant is out of range", expression.line);
+        
+        label.value = result.value;
+        label.constant = true;
+    }
+    
+    for(Statement& statement : assembly.statements)
+    {
+        if(statement.operand & STATEMENT_EXPRESSION)
+        {
+            const Expression& expression = assembly.expressions[statement.operand & ~STATEMENT_EXPRESSION];
+            ExpressionResult result = evaluateExpression(assembly.terms.data() + expression.firstTerm, expression.termCount, lookup);
+            uint32_t mask = g_instructionEncodings.encodings[statement.instruction].operandMask;
+            
+            if(result.status == EXPRESSION_PENDING)
+                fail("undefined symbol", assembly.labels[result.symbol].line);
+            
+            if(result.status == EXPRESSION_ERROR)
+                fail(result.error, expression.line);
+            
+            if(!operandFits(result.value, mask))
+                fail("expression is out of range", expression.line);
+            
+            statement.operand = result.value & mask;
+            continue;
+        }
+        
+        if(!(statement.operand & STATEMENT_SYMBOL))
+            continue;
+        
+        const Label& label = assembly.labels[statement.operand & ~STATEMENT_SYMBOL];
+        
+        if(label.value < 0)
+            fail("undefined symbol", label.line);
+        
+        if(label.value > 0xfff)
+            fail("symbol is out of range", label.line);
+        
+        statement.operand = label.value;
+    }
+    
+    
+    // encode into the image, catching what encodeStatements() catches
+    int lowest = 0x10000;
+    int highest = -1;
+    
+    for(const Statement& statement : assembly.statements)
+    {
+        int end = statement.offset + statementSize(statement) - 1;
+        
+        lowest = statement.offset < lowest ? statement.offset : lowest;
+        highest = end > highest ? end : highest;
+    }
+    
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> covered;
+    
+    origin = lowest <= highest ? lowest : 0;
+    
+    if(lowest > highest)
+        return image;
+    
+    image.assign(highest - lowest + 1, fill);
+    covered.assign(highest - lowest + 1, 0);
+    
+    for(size_t statementIndex = 0; statementIndex < assembly.statements.size(); ++statementIndex)
+    {
+        const Statement& statement = assembly.statements[statementIndex];
+        uint16_t word = encodeInstruction(statement.instruction, statement.x, statement.y, statement.operand);
+        int size = statementSize(statement);
+        int address = statement.offset - lowest;
+        
+        for(int index = 0; index < size; ++index)
+        {
+            if(covered[address + index])
+                fail("statement overlaps previously emitted bytes", assembly.statementLines[statementIndex]);
+            
+            covered[address + index] = 1;
+            image[address + index] = size == 1 ? word : index == 0 ? word >> 8 : word;
+        }
+    }
+    
+    return image;
+}
+
+
+struct Layout
+{
+    int origin;
+    size_t size;
+};
+
+
+//
+//
+//
+
+constexpr Layout measureSource(std::string_view source)
+{
+    int origin = 0;
+    size_t size = assembleSource(source, 0, origin).size();
+    
+    return { origin, size };
+}
+
+
+// a variable template, so each source is measured once however often its
+// size or origin is asked for
+template<SourceLiteral Source>
+inline constexpr Layout g_layout = measureSource(Source.view());
+
+
+}  // namespace compiletime
+
+
+//
+// the rom as bytes from its first address, like Result::image
+//
+
+template<SourceLiteral Source, uint8_t Fill = 0>
+consteval auto assemble()
+{
+    constexpr size_t size = compiletime::g_layout<Source>.size;
+    
+    int origin = 0;
+    std::vector<uint8_t> image = compiletime::assembleSource(Source.view(), Fill, origin);
+    std::array<uint8_t, size> rom = {};
+    
+    for(size_t index = 0; index < size; ++index)
+        rom[index] = image[index];
+    
+    return rom;
+}
+
+
+//
+// the address assemble() puts the first byte at, like Result::origin
+//
+
+template<SourceLiteral Source>
+consteval uint16_t imageOrigin()
+{
+    return compiletime::g_layout<Source>.origin;
+}
+
+
+}  // namespace chip8asm
+
+
+#endif
+#endif
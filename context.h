@@ -0,0 +1,132 @@
+#ifndef CHIP8ASM_CONTEXT_H
+#define CHIP8ASM_CONTEXT_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+#include "chip8asm.h"
+#include "expression.h"
+#include "image.h"
+#include "instructions.h"
+#include "source.h"
+#include "symbols.h"
+#include "tokenizer.h"
+
+
+namespace chip8asm
+{
+
+
+// the bytes of one data line, emitted with a single copy: .byte and .word
+// values are gathered into the arena, an .incbin file is used straight from
+// its mapping, and .fill and .space have no bytes, just a repeated value
+struct DataBlock
+{
+    const uint8_t *bytes;    // nullptr to repeat value instead
+    uint32_t size;
+    uint8_t value;
+    bool mapped;             // bytes belong to a file in Context::binaries
+};
+
+
+// a single-pass statement waiting for a label, and the next one waiting for
+// the same label, 1-based
+struct Fixup
+{
+    Statement statement;
+    uint32_t next;
+};
+
+
+// everything one assembly touches, so separate assemblies never share state;
+// labels, statements and image pages live in the arena, so reset() frees
+// them all at once and a reused context allocates next to nothing
+struct Context
+{
+    Options options;
+    
+    Arena arena;
+    SymbolTable symbols{ &arena };
+    ArenaVector<Statement> statements{ &arena };
+    ArenaVector<int> statementLines{ &arena };  // source line of each statement
+    ArenaVector<DataBlock> blocks{ &arena };
+    ArenaVector<Expression> expressions{ &arena };
+    ArenaVector<ExpressionTerm> terms{ &arena };
+    ArenaVector<Constant> constants{ &arena };  // in source order
+    std::vector<std::unique_ptr<SourceFile>> binaries;   // .incbin files
+    std::vector<Diagnostic> diagnostics;
+    Statistics stats;
+    
+    TokenList tokens;
+    ExpressionTerm scratchTerms[MAX_EXPRESSION_TERMS];   // an operand's terms while it is parsed
+    int lineNumber = 0;
+    int offset = 0x0200;        // address where chip-8 files are loaded, up to $10000
+    
+    // set while parsing a chunk whose base address is not known yet; the
+    // first .org makes the statements from firstAbsolute onward absolute,
+    // and relativeEnd keeps the offset the ones before it reached
+    bool relative = false;
+    size_t firstAbsolute = 0;
+    int relativeEnd = 0;
+    
+    // what the line parsed last did, for callers that keep per-line records
+    uint32_t lineLabel = SYMBOL_NONE;
+    bool lineOrigin = false;
+    bool lineConstant = false;
+    
+    // set for a single-pass assembly: statements are encoded into the image
+    // as they are parsed, and those naming a label not defined yet wait in
+    // fixups, chained from the label, until the definition patches them;
+    // patched fixups are chained onto freeFixups
+    RomImage *image = nullptr;
+    ArenaVector<Fixup> fixups{ &arena };
+    uint32_t freeFixups = 0;
+    
+    Context() = default;
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    
+    void reset(const Options& options);
+    
+    void error(int line, int column, const char *format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 4, 5)))
+#endif
+        ;
+};
+
+
+// wall clock for the phase timings
+typedef std::chrono::steady_clock Clock;
+
+inline double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// statementSize() for statements that may be data blocks
+inline int statementSize(const Context& context, const Statement& statement)
+{
+    return statement.instruction == INST_DATABLOCK ? context.blocks[statement.operand].size : statementSize(statement);
+}
+
+
+bool parseLine(Context& context, std::string_view line);
+bool parseSource(Context& context, std::string_view source);
+bool parseSourceParallel(Context& context, std::string_view source, int threads);
+bool resolveOperand(Context& context, const Statement& statement, uint32_t& operand, uint32_t *pending);
+bool resolveSymbols(Context& context);
+bool resolveFixups(Context& context);
+bool encodeStatement(const Statement& statement, uint32_t operand, uint16_t& word);
+bool encodeStatements(Context& context, RomImage& image);
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef CHIP8ASM_EXPRESSION_H
+#define CHIP8ASM_EXPRESSION_H
+
+#include <cstdint>
+#include <string_view>
+
+#include "tokenizer.h"
+
+
+namespace chip8asm
+{
+
+
+// an operand may be an expression over literals, labels and .equ constants,
+// with c's precedence: unary ~, - and hi() lo(), then * /, + -, << >>, &
+// and last |. it is parsed into terms in reverse polish order, folded to a
+// value right away when every name in it is a known constant, and kept for
+// resolution otherwise. parsing and evaluating are constexpr, so the
+// compile-time front end reads expressions exactly as the assembler does
+enum ExpressionOperatorEnum : uint8_t
+{
+    EXPRESSION_CONSTANT,     // pushes value
+    EXPRESSION_SYMBOL,       // pushes the value of the symbol with id value
+    EXPRESSION_NEGATE,
+    EXPRESSION_NOT,
+    EXPRESSION_HIGH,         // bits 8 to 15
+    EXPRESSION_LOW,          // bits 0 to 7
+    EXPRESSION_MULTIPLY,
+    EXPRESSION_DIVIDE,
+    EXPRESSION_ADD,
+    EXPRESSION_SUBTRACT,
+    EXPRESSION_SHIFT_LEFT,
+    EXPRESSION_SHIFT_RIGHT,
+    EXPRESSION_AND,
+    EXPRESSION_OR
+};
+
+
+struct ExpressionTerm
+{
+    uint8_t op;
+    int32_t value;
+};
+
+
+// an expression takes one term per name, literal and operator
+inline constexpr int MAX_EXPRESSION_TERMS = 64;
+inline constexpr int MAX_EXPRESSION_DEPTH = 32;
+
+
+// an operand that could not be folded while parsing: termCount terms from
+// firstTerm, and the line it was written on, for errors
+struct Expression
+{
+    uint32_t firstTerm;
+    uint32_t termCount;
+    int line;
+};
+
+
+// an .equ whose value names a label, so it is known only once labels are
+struct Constant
+{
+    uint32_t symbol;
+    uint32_t expression;
+};
+
+
+// what evaluating an expression came to
+enum ExpressionStatusEnum : uint8_t
+{
+    EXPRESSION_VALUE,        // value holds the result
+    EXPRESSION_PENDING,      // symbol names a label not known yet
+    EXPRESSION_ERROR         // error says why
+};
+
+
+struct ExpressionResult
+{
+    uint8_t status;
+    int32_t value;
+    uint32_t symbol;
+    const char *error;
+};
+
+
+// immediates and data may go negative down to half their range, so that
+// add v0, -1 works; addresses may not
+constexpr bool operandFits(int32_t value, uint32_t mask)
+{
+    int32_t lowest = mask == 0x0fff ? 0 : -(int32_t) ((mask + 1) / 2);
+    
+    return value >= lowest  &&  value <= (int32_t) mask;
+}
+
+
+namespace expression
+{
+
+
+constexpr bool isSpace(char c)
+{
+    return c == ' '  ||  (c >= '\t'  &&  c <= '\r');
+}
+
+
+//
+// recursive descent over lowercase text, climbing binary operators by
+// precedence; intern turns a name into a symbol id
+//
+
+template<typename Intern>
+struct Parser
+{
+    std::string_view text;
+    size_t position;
+    ExpressionTerm *terms;
+    int count;
+    int depth;
+    Intern& intern;
+    
+    
+    constexpr bool add(uint8_t op, int32_t value = 0)
+    {
+        if(count == MAX_EXPRESSION_TERMS)
+            return false;
+        
+        terms[count++] = { op, value };
+        return true;
+    }
+    
+    
+    constexpr char peek()
+    {
+        while(position < text.size()  &&  isSpace(text[position]))
+            ++position;
+        
+        return position < text.size() ? text[position] : '\0';
+    }
+    
+    
+    constexpr bool expect(char c)
+    {
+        if(peek() != c)
+            return false;
+        
+        ++position;
+        return true;
+    }
+    
+    
+    // the binary operator at the cursor and how tightly it binds, 0 for
+    // none; with c's precedence, | binds loosest and * / tightest
+    constexpr int binaryOperator(uint8_t& op)
+    {
+        char c = peek();
+        char next = position + 1 < text.size() ? text[position + 1] : '\0';
+        
+        switch(c)
+        {
+            case '|':  op = EXPRESSION_OR;  return 1;
+            case '&':  op = EXPRESSION_AND;  return 2;
+            case '<':  op = EXPRESSION_SHIFT_LEFT;  return next == '<' ? 3 : 0;
+            case '>':  op = EXPRESSION_SHIFT_RIGHT;  return next == '>' ? 3 : 0;
+            case '+':  op = EXPRESSION_ADD;  return 4;
+            case '-':  op = EXPRESSION_SUBTRACT;  return 4;
+            case '*':  op = EXPRESSION_MULTIPLY;  return 5;
+            case '/':  op = EXPRESSION_DIVIDE;  return 5;
+        }
+        
+        return 0;
+    }
+    
+    
+    // precedence climbing: operands and operators for as long as the
+    // operators bind at least as tightly as precedence
+    constexpr bool parseBinary(int precedence)
+    {
+        if(!parseUnary())
+            return false;
+        
+        uint8_t op = 0;
+        int binding;
+        
+        while((binding = binaryOperator(op)) >= precedence)
+        {
+            position += binding == 3 ? 2 : 1;
+            
+            if(!parseBinary(binding + 1)  ||  !add(op))
+                return false;
+        }
+        
+        return true;
+    }
+    
+    
+    constexpr bool parseUnary()
+    {
+        if(++depth > MAX_EXPRESSION_DEPTH)
+            return false;
+        
+        bool parsed;
+        
+        if(expect('-'))
+            parsed = parseUnary()  &&  add(EXPRESSION_NEGATE);
+        else if(expect('~'))
+            parsed = parseUnary()  &&  add(EXPRESSION_NOT);
+        else if(expect('+'))
+            parsed = parseUnary();
+        else if(expect('('))
+            parsed = parseBinary(1)  &&  expect(')');
+        else
+            parsed = parsePrimary();
+        
+        --depth;
+        return parsed;
+    }
+    
+    
+    // a literal, a name, or hi( and lo( with their argument
+    constexpr bool parsePrimary()
+    {
+        peek();
+        
+        size_t start = position;
+        
+        while(position < text.size()  &&  !isSpace(text[position])  &&  !isExpressionCharacter(text[position]))
+            ++position;
+        
+        std::string_view word = text.substr(start, position - start);
+        char c = word.empty() ? '\0' : word[0];
+        int value = 0;
+        
+        if(word.empty())
+            return false;
+        
+        if((word == "hi"  ||  word == "lo")  &&  expect('('))
+            return parseBinary(1)  &&  expect(')')  &&  add(word == "hi" ? EXPRESSION_HIGH : EXPRESSION_LOW);
+        
+        if((c >= '0'  &&  c <= '9')  ||  c == '$'  ||  c == '%')
+            return parseInteger(word, value)  &&  add(EXPRESSION_CONSTANT, value);
+        
+        // registers have no value
+        if(parseRegister(word, value))
+            return false;
+        
+        return add(EXPRESSION_SYMBOL, (int32_t) intern(word));
+    }
+};
+
+
+}  // namespace expression
+
+
+//
+// parses lowercase text into count terms; false if it is not an expression
+// or needs more than MAX_EXPRESSION_TERMS
+//
+
+template<typename Intern>
+constexpr bool parseExpression(std::string_view lower, ExpressionTerm *terms, int& count, Intern&& intern)
+{
+    expression::Parser<Intern> parser = { lower, 0, terms, 0, 0, intern };
+    
+    bool parsed = parser.parseBinary(1)  &&  parser.peek() == '\0';
+    
+    count = parser.count;
+    return parsed;
+}
+
+
+//
+// runs the terms on a stack; lookup(id, value) gives a symbol's value, or
+// false if it has none yet. every step must stay within 32 bits, so an
+// expression means the same thing on every host
+//
+
+template<typename Lookup>
+constexpr ExpressionResult evaluateExpression(const ExpressionTerm *terms, int count, Lookup&& lookup)
+{
+    int64_t stack[MAX_EXPRESSION_TERMS] = {};
+    int depth = 0;
+    
+    for(int index = 0; index < count; ++index)
+    {
+        const ExpressionTerm& term = terms[index];
+        int value = 0;
+        
+        if(term.op == EXPRESSION_CONSTANT)
+        {
+            stack[depth++] = term.value;
+            continue;
+        }
+        
+        if(term.op == EXPRESSION_SYMBOL)
+        {
+            if(!lookup((uint32_t) term.value, value))
+                return { EXPRESSION_PENDING, 0, (uint32_t) term.value, nullptr };
+            
+            stack[depth++] = value;
+            continue;
+        }
+        
+        
+        // operators work on the top of the stack, binary ones pop their
+        // right operand off it first
+        int64_t right = stack[depth - 1];
+        
+        if(term.op >= EXPRESSION_MULTIPLY)
+            --depth;
+        
+        int64_t& top = stack[depth - 1];
+        
+        switch(term.op)
+        {
+            case EXPRESSION_NEGATE:    top = -top;  break;
+            case EXPRESSION_NOT:       top = ~top;  break;
+            case EXPRESSION_HIGH:      top = (top >> 8) & 0xff;  break;
+            case EXPRESSION_LOW:       top = top & 0xff;  break;
+            case EXPRESSION_MULTIPLY:  top *= right;  break;
+            case EXPRESSION_ADD:       top += right;  break;
+            case EXPRESSION_SUBTRACT:  top -= right;  break;
+            case EXPRESSION_AND:       top &= right;  break;
+            case EXPRESSION_OR:        top |= right;  break;
+            
+            case EXPRESSION_DIVIDE:
+                if(right == 0)
+                    return { EXPRESSION_ERROR, 0, 0, "division by zero" };
+                
+                top /= right;
+                break;
+            
+            case EXPRESSION_SHIFT_LEFT:
+            case EXPRESSION_SHIFT_RIGHT:
+                if(right < 0  ||  right > 31)
+                    return { EXPRESSION_ERROR, 0, 0, "shift count is out of range" };
+                
+                top = term.op == EXPRESSION_SHIFT_LEFT ? top * ((int64_t) 1 << right) : top >> right;
+                break;
+        }
+        
+        if(top < INT32_MIN  ||  top > INT32_MAX)
+            return { EXPRESSION_ERROR, 0, 0, "expression overflows" };
+    }
+    
+    return { EXPRESSION_VALUE, (int32_t) stack[0], 0, nullptr };
+}
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,149 @@
+#include "image.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace chip8asm
+{
+
+
+//
+// the page holding address, taken from the arena and filled on first use
+//
+
+static uint8_t *imagePage(RomImage& image, int address)
+{
+    uint8_t *&page = image.pages[address / IMAGE_PAGE_SIZE];
+    
+    if(!page)
+    {
+        page = (uint8_t *) image.arena.allocate(IMAGE_PAGE_SIZE, 1);
+        memset(page, image.fill, IMAGE_PAGE_SIZE);
+    }
+    
+    return page;
+}
+
+
+//
+// bits of the occupancy word holding position, from position up to end
+//
+
+static uint64_t occupancyMask(int position, int end, int& count)
+{
+    int bit = position & 63;
+    
+    count = std::min(64 - bit, end - position);
+    return (count == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << count) - 1) << bit;
+}
+
+
+//
+//
+//
+
+bool storeByte(RomImage& image, int address, uint8_t byte)
+{
+    if(address > 0xffff)
+        return false;
+    
+    uint64_t bit = (uint64_t) 1 << (address & 63);
+    uint64_t& occupied = image.occupied[address >> 6];
+    
+    if(occupied & bit)
+        return false;
+    
+    occupied |= bit;
+    imagePage(image, address)[address % IMAGE_PAGE_SIZE] = byte;
+    
+    image.lowest = std::min(image.lowest, address);
+    image.highest = std::max(image.highest, address);
+    return true;
+}
+
+
+//
+// a run of bytes, or of value repeated when bytes is null, copied in a
+// page at a time; nothing is stored unless the whole run is free
+//
+
+bool storeBytes(RomImage& image, int address, const uint8_t *bytes, size_t size, uint8_t value)
+{
+    if(size == 0)
+        return true;
+    
+    if(address + size > 0x10000)
+        return false;
+    
+    int end = address + (int) size;
+    int count;
+    
+    for(int position = address; position < end; position += count)
+    {
+        if(image.occupied[position >> 6] & occupancyMask(position, end, count))
+            return false;
+    }
+    
+    for(int position = address; position < end; position += count)
+        image.occupied[position >> 6] |= occupancyMask(position, end, count);
+    
+    
+    for(int position = address; position < end; )
+    {
+        int pageEnd = std::min((position / IMAGE_PAGE_SIZE + 1) * IMAGE_PAGE_SIZE, end);
+        uint8_t *target = imagePage(image, position) + position % IMAGE_PAGE_SIZE;
+        
+        if(bytes)
+            memcpy(target, bytes + (position - address), pageEnd - position);
+        else
+            memset(target, value, pageEnd - position);
+        
+        position = pageEnd;
+    }
+    
+    image.lowest = std::min(image.lowest, address);
+    image.highest = std::max(image.highest, end - 1);
+    return true;
+}
+
+
+//
+// rewrites a byte that storeByte already placed
+//
+
+void patchByte(RomImage& image, int address, uint8_t byte)
+{
+    image.pages[address / IMAGE_PAGE_SIZE][address % IMAGE_PAGE_SIZE] = byte;
+}
+
+
+//
+//
+//
+
+void flattenImage(const RomImage& image, std::vector<uint8_t>& bytes)
+{
+    if(image.lowest > image.highest)
+    {
+        bytes.clear();
+        return;
+    }
+    
+    // untouched pages are gaps, so they keep the fill byte
+    bytes.assign(image.highest - image.lowest + 1, image.fill);
+    
+    for(int address = image.lowest; address <= image.highest; )
+    {
+        int page = address / IMAGE_PAGE_SIZE;
+        int pageEnd = std::min((page + 1) * IMAGE_PAGE_SIZE, image.highest + 1);
+        
+        if(image.pages[page])
+            memcpy(&bytes[address - image.lowest], &image.pages[page][address % IMAGE_PAGE_SIZE], pageEnd - address);
+        
+        address = pageEnd;
+    }
+}
+
+
+}  // namespace chip8asm
@@ -0,0 +1,42 @@
+#ifndef CHIP8ASM_IMAGE_H
+#define CHIP8ASM_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+
+
+namespace chip8asm
+{
+
+
+// sparse image of the 64 KiB address space; pages are taken from the arena
+// on first write and the occupancy bitmap catches statements that overlap
+inline constexpr int IMAGE_PAGE_SIZE = 256;
+
+struct RomImage
+{
+    explicit RomImage(Arena& arena)  : arena(arena) {}
+    
+    Arena& arena;
+    uint8_t *pages[0x10000 / IMAGE_PAGE_SIZE] = {};
+    uint64_t occupied[0x10000 / 64] = {};
+    
+    int lowest = 0x10000;
+    int highest = -1;
+    uint8_t fill = 0;
+};
+
+
+bool storeByte(RomImage& image, int address, uint8_t byte);
+bool storeBytes(RomImage& image, int address, const uint8_t *bytes, size_t size, uint8_t value);
+void patchByte(RomImage& image, int address, uint8_t byte);
+void flattenImage(const RomImage& image, std::vector<uint8_t>& bytes);
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,481 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace chip8asm
+{
+
+
+// an edit leaves the data blocks, expressions and names of the lines it
+// replaced in the arena, and their .incbin files mapped; once these grow to
+// this many times what a full assembly needs, the next update starts over
+constexpr size_t INCREMENTAL_GROWTH_LIMIT = 2;
+
+// and not before this much, so a small source is not rebuilt every edit
+constexpr size_t INCREMENTAL_ARENA_SLACK = 256 * 1024;
+constexpr size_t INCREMENTAL_BINARY_SLACK = 16;
+
+
+//
+//
+//
+
+IncrementalAssembler::IncrementalAssembler(const Options& options)
+    : m_options(options), m_memory(0x10000, options.fill), m_coverage(0x10000, 0)
+{
+}
+
+
+//
+//
+//
+
+void IncrementalAssembler::clear()
+{
+    m_context.reset(m_options);
+    
+    m_source.clear();
+    m_lines.clear();
+    m_statements.clear();
+    
+    m_definitions.clear();
+    m_changed.clear();
+    m_changedIds.clear();
+    
+    std::fill(m_memory.begin(), m_memory.end(), m_options.fill);
+    std::fill(m_coverage.begin(), m_coverage.end(), 0);
+    m_coveredBytes = 0;
+    m_overlaps = 0;
+    m_endOffset = 0x0200;
+}
+
+
+//
+//
+//
+
+Result IncrementalAssembler::update(std::string_view source)
+{
+    m_reparsedLines = 0;
+    
+    bool overgrown = m_context.arena.used() > m_rebuildArena * INCREMENTAL_GROWTH_LIMIT + INCREMENTAL_ARENA_SLACK  ||
+        m_context.binaries.size() > m_rebuildBinaries * INCREMENTAL_GROWTH_LIMIT + INCREMENTAL_BINARY_SLACK;
+    
+    bool patched = m_valid  &&  !overgrown  &&  patch(source, false);
+    
+    if(!patched)
+    {
+        clear();
+        patched = patch(source, true);
+        
+        m_rebuildArena = m_context.arena.used();
+        m_rebuildBinaries = m_context.binaries.size();
+    }
+    
+    m_valid = patched;
+    
+    // the full assembler reports the same diagnostics a normal run would
+    if(!patched)
+        return Assembler(m_options).assemble(source);
+    
+    
+    Result result;
+    int lowest = 0;
+    int highest = 0xffff;
+    
+    while(lowest <= highest  &&  !m_coverage[lowest])
+        ++lowest;
+    
+    while(highest >= lowest  &&  !m_coverage[highest])
+        --highest;
+    
+    if(lowest <= highest)
+    {
+        result.origin = lowest;
+        result.image.assign(m_memory.begin() + lowest, m_memory.begin() + highest + 1);
+    }
+    
+    result.success = true;
+    result.stats = m_context.stats;
+    result.stats.lines = m_lines.size();
+    result.stats.statements = m_statements.size();
+    result.stats.symbols = m_context.symbols.size();
+    result.stats.bytes = m_coveredBytes;
+    return result;
+}
+
+
+//
+// applies the edit between the current source and the new one; returns
+// false for anything it cannot patch, leaving the state to be rebuilt
+//
+
+bool IncrementalAssembler::patch(std::string_view source, bool rebuild)
+{
+    // split the new text into lines the way parseSource() does
+    m_newLines.clear();
+    
+    for(size_t start = 0; start < source.size(); )
+    {
+        const char *newline = (const char *) memchr(source.data() + start, '\n', source.size() - start);
+        size_t end = newline ? newline - source.data() : source.size();
+        
+        m_newLines.push_back({ (uint32_t) start, (uint32_t) (end - start), 0, SYMBOL_NONE, 0, false, false });
+        start = end + 1;
+    }
+    
+    
+    // lines at either end that did not change keep everything they had
+    size_t oldCount = m_lines.size();
+    size_t newCount = m_newLines.size();
+    size_t first = 0;
+    size_t last = 0;
+    
+    auto sameLine = [&](size_t oldIndex, size_t newIndex)
+    {
+        return std::string_view(m_source).substr(m_lines[oldIndex].start, m_lines[oldIndex].length) ==
+            source.substr(m_newLines[newIndex].start, m_newLines[newIndex].length);
+    };
+    
+    while(first < oldCount  &&  first < newCount  &&  sameLine(first, first))
+        ++first;
+    
+    while(last < oldCount - first  &&  last < newCount - first  &&  sameLine(oldCount - 1 - last, newCount - 1 - last))
+        ++last;
+    
+    size_t oldEnd = oldCount - last;
+    size_t newEnd = newCount - last;
+    
+    int startOffset = first < oldCount ? m_lines[first].offset : m_endOffset;
+    int oldEndOffset = oldEnd < oldCount ? m_lines[oldEnd].offset : m_endOffset;
+    size_t firstStatement = first < oldCount ? m_lines[first].firstStatement : m_statements.size();
+    size_t oldEndStatement = oldEnd < oldCount ? m_lines[oldEnd].firstStatement : m_statements.size();
+    
+    
+    // labels defined by the replaced lines go away; one defined twice would
+    // need the other definition's address, and a constant may have been
+    // folded anywhere, so those are left to a rebuild
+    SymbolTable& symbols = m_context.symbols;
+    
+    for(size_t index = first; index < oldEnd; ++index)
+    {
+        uint32_t label = m_lines[index].label;
+        
+        if(m_lines[index].constant)
+            return false;
+        
+        if(label == SYMBOL_NONE)
+            continue;
+        
+        if(--m_definitions[label] != 0)
+            return false;
+        
+        symbols.symbols[label].value = -1;
+        markChanged(label);
+    }
+    
+    
+    // parse the new lines at the address the old ones started at
+    Context& context = m_context;
+    
+    context.statements.clear();
+    context.statementLines.clear();
+    context.diagnostics.clear();
+    context.stats = Statistics();
+    context.offset = startOffset;
+    
+    for(size_t index = first; index < newEnd; ++index)
+    {
+        Line& line = m_newLines[index];
+        
+        line.offset = context.offset;
+        line.firstStatement = firstStatement + context.statements.size();
+        context.lineNumber = index + 1;
+        
+        if(!parseLine(context, source.substr(line.start, line.length)))
+            return false;
+        
+        line.label = context.lineLabel;
+        line.origin = context.lineOrigin;
+        line.constant = context.lineConstant;
+        
+        if(line.constant  &&  !rebuild)
+            return false;
+        
+        if(line.label == SYMBOL_NONE)
+            continue;
+        
+        if(m_definitions.size() < symbols.symbols.size())
+            m_definitions.resize(symbols.symbols.size(), 0);
+        
+        if(++m_definitions[line.label] > 1  &&  !rebuild)
+            return false;
+        
+        markChanged(line.label);
+    }
+    
+    m_reparsedLines = newEnd - first;
+    
+    // a constant naming labels would have to follow them about, so a source
+    // with one is always assembled in full
+    if(!context.constants.empty())
+        return false;
+    
+    
+    // the unchanged lines after the edit move with it, up to and including
+    // the next .org
+    int delta = context.offset - oldEndOffset;
+    size_t shiftEnd = oldEnd;
+    bool pinned = false;
+    
+    if(delta)
+    {
+        while(shiftEnd < oldCount  &&  !m_lines[shiftEnd].origin)
+            ++shiftEnd;
+        
+        if(shiftEnd < oldCount)
+        {
+            ++shiftEnd;
+            pinned = true;
+        }
+    }
+    
+    size_t shiftEndStatement = shiftEnd < oldCount ? m_lines[shiftEnd].firstStatement : m_statements.size();
+    
+    
+    // take the bytes of the replaced and moving statements out of the image
+    for(size_t index = firstStatement; index < shiftEndStatement; ++index)
+        uncover(m_statements[index]);
+    
+    m_statements.erase(m_statements.begin() + firstStatement, m_statements.begin() + oldEndStatement);
+    m_statements.insert(m_statements.begin() + firstStatement, context.statements.begin(), context.statements.end());
+    
+    size_t statementDelta = context.statements.size() - (oldEndStatement - firstStatement);
+    size_t newEndStatement = firstStatement + context.statements.size();
+    size_t movedEndStatement = shiftEndStatement + statementDelta;
+    
+    for(size_t index = newEndStatement; index < movedEndStatement; ++index)
+        m_statements[index].offset += delta;
+    
+    for(size_t index = oldEnd; index < oldCount; ++index)
+    {
+        Line& line = m_lines[index];
+        
+        line.firstStatement += statementDelta;
+        
+        if(index >= shiftEnd)
+            continue;
+        
+        line.offset += delta;
+        
+        // pushed past the end of memory: the full assembly says where
+        if(line.offset > 0x10000)
+            return false;
+        
+        if(line.label != SYMBOL_NONE)
+        {
+            if(m_definitions[line.label] > 1)
+                return false;
+            
+            symbols.symbols[line.label].value += delta;
+            markChanged(line.label);
+        }
+    }
+    
+    if(!pinned)
+        m_endOffset += delta;
+    
+    if(m_endOffset > 0x10000)
+        return false;
+    
+    
+    // rebuild the line records: untouched lines keep theirs at their new
+    // place in the text
+    for(size_t index = 0; index < newCount; ++index)
+    {
+        if(index >= first  &&  index < newEnd)
+            continue;
+        
+        Line& line = m_newLines[index];
+        const Line& old = m_lines[index < first ? index : index - newEnd + oldEnd];
+        
+        line = { line.start, line.length, old.firstStatement, old.label, old.offset, old.origin, old.constant };
+    }
+    
+    m_lines.swap(m_newLines);
+    
+    
+    // put the new and moved statements back into the image, then patch the
+    // statements elsewhere that refer to a label that moved
+    bool emitted = true;
+    
+    for(size_t index = firstStatement; index < movedEndStatement; ++index)
+        emitted = emitted  &&  cover(m_statements[index]);
+    
+    for(size_t index = firstStatement; index < movedEndStatement; ++index)
+        emitted = emitted  &&  emit(m_statements[index]);
+    
+    if(!m_changedIds.empty()  &&  !rebuild)
+    {
+        // lines parsed since the last change may have added symbols
+        m_changed.resize(symbols.symbols.size(), 0);
+        
+        for(size_t index = 0; emitted  &&  index < m_statements.size(); ++index)
+        {
+            const Statement& statement = m_statements[index];
+            
+            if(index >= firstStatement  &&  index < movedEndStatement)
+                continue;
+            
+            if(refersToChanged(statement))
+                emitted = emit(statement);
+        }
+    }
+    
+    for(uint32_t id : m_changedIds)
+        m_changed[id] = 0;
+    
+    m_changedIds.clear();
+    m_source.assign(source);
+    
+    return emitted  &&  m_overlaps == 0;
+}
+
+
+//
+// counts the statement's bytes into the coverage map; false if it runs past
+// the end of memory
+//
+
+bool IncrementalAssembler::cover(const Statement& statement)
+{
+    int size = statementSize(m_context, statement);
+    
+    if(statement.offset + size > 0x10000)
+        return false;
+    
+    for(int address = statement.offset; address < statement.offset + size; ++address)
+    {
+        uint32_t count = ++m_coverage[address];
+        
+        if(count == 1)
+            ++m_coveredBytes;
+        else if(count == 2)
+            ++m_overlaps;
+    }
+    
+    return true;
+}
+
+
+//
+//
+//
+
+void IncrementalAssembler::uncover(const Statement& statement)
+{
+    int size = std::min(statementSize(m_context, statement), 0x10000 - statement.offset);
+    
+    for(int address = statement.offset; address < statement.offset + size; ++address)
+    {
+        uint32_t count = --m_coverage[address];
+        
+        if(count == 0)
+        {
+            --m_coveredBytes;
+            m_memory[address] = m_options.fill;
+        }
+        else if(count == 1)
+            --m_overlaps;
+    }
+}
+
+
+//
+// resolves and encodes one statement straight into the image
+//
+
+bool IncrementalAssembler::emit(const Statement& statement)
+{
+    uint32_t operand = statement.operand;
+    uint16_t word;
+    
+    // cover() has already checked that a block fits
+    if(statement.instruction == INST_DATABLOCK)
+    {
+        const DataBlock& block = m_context.blocks[operand];
+        
+        if(block.bytes)
+            memcpy(&m_memory[statement.offset], block.bytes, block.size);
+        else
+            memset(&m_memory[statement.offset], block.value, block.size);
+        
+        return true;
+    }
+    
+    // a label or expression that does not resolve sends the source back
+    // to the full assembler, which reports it
+    if(!resolveOperand(m_context, statement, operand, nullptr))
+        return false;
+    
+    if(!encodeStatement(statement, operand, word))
+        return false;
+    
+    if(statementSize(statement) == 1)
+        m_memory[statement.offset] = word;
+    else
+    {
+        m_memory[statement.offset] = word >> 8;
+        m_memory[statement.offset + 1] = word;
+    }
+    
+    return true;
+}
+
+
+//
+// whether the statement names a symbol whose value moved
+//
+
+bool IncrementalAssembler::refersToChanged(const Statement& statement) const
+{
+    if(statement.operand & STATEMENT_SYMBOL)
+        return m_changed[statement.operand & ~STATEMENT_SYMBOL];
+    
+    if(!(statement.operand & STATEMENT_EXPRESSION))
+        return false;
+    
+    const Expression& expression = m_context.expressions[statement.operand & ~STATEMENT_EXPRESSION];
+    
+    for(uint32_t index = 0; index < expression.termCount; ++index)
+    {
+        const ExpressionTerm& term = m_context.terms[expression.firstTerm + index];
+        
+        if(term.op == EXPRESSION_SYMBOL  &&  m_changed[term.value])
+            return true;
+    }
+    
+    return false;
+}
+
+
+//
+//
+//
+
+void IncrementalAssembler::markChanged(uint32_t id)
+{
+    if(m_changed.size() <= id)
+        m_changed.resize(m_context.symbols.symbols.size(), 0);
+    
+    if(!m_changed[id])
+    {
+        m_changed[id] = 1;
+        m_changedIds.push_back(id);
+    }
+}
+
+
+}  // namespace chip8asm
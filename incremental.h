@@ -0,0 +1,85 @@
+#ifndef CHIP8ASM_INCREMENTAL_H
+#define CHIP8ASM_INCREMENTAL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chip8asm.h"
+#include "context.h"
+
+
+namespace chip8asm
+{
+
+
+// keeps one source parsed in memory between edits; an update tokenizes and
+// parses only the lines that changed, shifts the addresses of the lines
+// after them, re-resolves the labels that moved and patches the image in
+// place. anything it cannot patch, such as a label defined twice, falls
+// back to assembling the whole source again, as does any edit to an .equ
+class IncrementalAssembler
+{
+public:
+    explicit IncrementalAssembler(const Options& options = Options());
+    
+    IncrementalAssembler(const IncrementalAssembler&) = delete;
+    IncrementalAssembler& operator=(const IncrementalAssembler&) = delete;
+    
+    Result update(std::string_view source);
+    
+    size_t reparsedLines() const  { return m_reparsedLines; }
+
+private:
+    struct Line
+    {
+        uint32_t start;          // position of the line in m_source
+        uint32_t length;
+        uint32_t firstStatement;
+        uint32_t label;          // symbol the line defines, or SYMBOL_NONE
+        int offset;              // address at the start of the line
+        bool origin;             // the line is an .org
+        bool constant;           // the line is an .equ
+    };
+    
+    void clear();
+    bool patch(std::string_view source, bool rebuild);
+    bool cover(const Statement& statement);
+    void uncover(const Statement& statement);
+    bool emit(const Statement& statement);
+    bool refersToChanged(const Statement& statement) const;
+    void markChanged(uint32_t id);
+    
+    Options m_options;
+    Context m_context;               // symbols, plus scratch for parsing lines
+    
+    std::string m_source;
+    std::vector<Line> m_lines;
+    std::vector<Line> m_newLines;
+    std::vector<Statement> m_statements;
+    
+    std::vector<uint32_t> m_definitions;   // lines defining each symbol
+    std::vector<uint8_t> m_changed;        // symbols whose value moved
+    std::vector<uint32_t> m_changedIds;
+    
+    std::vector<uint8_t> m_memory;         // the whole address space
+    std::vector<uint32_t> m_coverage;      // statements covering each address
+    size_t m_coveredBytes = 0;
+    size_t m_overlaps = 0;
+    int m_endOffset = 0x0200;
+    
+    bool m_valid = false;
+    size_t m_reparsedLines = 0;
+    
+    // what a full assembly of the source left in the context's arena and
+    // binaries, against which the garbage of later edits is measured
+    size_t m_rebuildArena = 0;
+    size_t m_rebuildBinaries = 0;
+};
+
+
+}  // namespace chip8asm
+
+
+#endif
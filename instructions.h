@@ -0,0 +1,361 @@
+#ifndef CHIP8ASM_INSTRUCTIONS_H
+#define CHIP8ASM_INSTRUCTIONS_H
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+
+namespace chip8asm
+{
+
+
+enum InstructionEnum
+{
+    INST_DEFINEBYTE,
+    INST_DEFINEWORD,
+    INST_DATABLOCK,          // operand indexes the context's data blocks
+    
+    INST_CLS,
+    INST_RET,
+    INST_JP_ADDR,
+    INST_CALL_ADDR,
+    INST_SE_VX_NN,
+    INST_SNE_VX_NN,
+    INST_SE_VX_VY,
+    INST_LD_VX_NN,
+    INST_ADD_VX_NN,
+    INST_LD_VX_VY,
+    INST_OR_VX_VY,
+    INST_AND_VX_VY,
+    INST_XOR_VX_VY,
+    INST_ADD_VX_VY,
+    INST_SUB_VX_VY,
+    INST_SHR_VX_VY,
+    INST_SUBN_VX_VY,
+    INST_SHL_VX_VY,
+    INST_SNE_VX_VY,
+    INST_LD_I_ADDR,
+    INST_JP_V0_ADDR,
+    INST_RND_VX_NN,
+    INST_DRW_VX_VY_N,
+    INST_SKP_VX,
+    INST_SKNP_VX,
+    INST_LD_VX_DT,
+    INST_LD_VX_N,
+    INST_LD_DT_VX,
+    INST_LD_ST_VX,
+    INST_ADD_I_VX,
+    INST_LD_F_VX,
+    INST_LD_B_VX,
+    INST_LD_I_VX,
+    INST_LD_VX_I,
+    
+    INST_COUNT
+};
+
+
+enum RegisterEnum
+{
+    REG_V0,
+    REG_V1,
+    REG_V2,
+    REG_V3,
+    REG_V4,
+    REG_V5,
+    REG_V6,
+    REG_V7,
+    REG_V8,
+    REG_V9,
+    REG_VA,
+    REG_VB,
+    REG_VC,
+    REG_VD,
+    REG_VE,
+    REG_VF,
+    REG_B,
+    REG_DT,
+    REG_F,
+    REG_I,
+    REG_I_INDIRECT,
+    REG_K,
+    REG_ST
+};
+
+
+enum OperandEnum
+{
+    OPERAND_NONE,
+    OPERAND_VX,
+    OPERAND_VY,
+    OPERAND_N,
+    OPERAND_NN,
+    OPERAND_ADDR,
+    
+    // operands that must name one specific register
+    OPERAND_REGISTER,
+    OPERAND_V0 = OPERAND_REGISTER + REG_V0,
+    OPERAND_B = OPERAND_REGISTER + REG_B,
+    OPERAND_DT = OPERAND_REGISTER + REG_DT,
+    OPERAND_F = OPERAND_REGISTER + REG_F,
+    OPERAND_I = OPERAND_REGISTER + REG_I,
+    OPERAND_I_INDIRECT = OPERAND_REGISTER + REG_I_INDIRECT,
+    OPERAND_K = OPERAND_REGISTER + REG_K,
+    OPERAND_ST = OPERAND_REGISTER + REG_ST
+};
+
+
+struct InstructionForm
+{
+    std::string_view mnemonic;
+    uint8_t instruction;
+    uint16_t opcode;         // the encoding with every operand field zero
+    uint8_t operands[3];
+    
+    constexpr int operandCount() const
+    {
+        int count = 0;
+        
+        while(count < 3  &&  operands[count] != OPERAND_NONE)
+            ++count;
+        
+        return count;
+    }
+};
+
+
+// operand shapes and opcode of every instruction form, grouped by mnemonic
+// and tried in order, so register forms must come before the immediate forms
+// they shadow; the encoder table below is derived from these rows
+inline constexpr InstructionForm g_instructionForms[] =
+{
+    { "add",   INST_ADD_VX_VY,    0x8004,  { OPERAND_VX, OPERAND_VY } },
+    { "add",   INST_ADD_I_VX,     0xf01e,  { OPERAND_I, OPERAND_VX } },
+    { "add",   INST_ADD_VX_NN,    0x7000,  { OPERAND_VX, OPERAND_NN } },
+    { "and",   INST_AND_VX_VY,    0x8002,  { OPERAND_VX, OPERAND_VY } },
+    { "call",  INST_CALL_ADDR,    0x2000,  { OPERAND_ADDR } },
+    { "cls",   INST_CLS,          0x00e0,  {} },
+    { "drw",   INST_DRW_VX_VY_N,  0xd000,  { OPERAND_VX, OPERAND_VY, OPERAND_N } },
+    { "jp",    INST_JP_V0_ADDR,   0xb000,  { OPERAND_V0, OPERAND_ADDR } },
+    { "jp",    INST_JP_ADDR,      0x1000,  { OPERAND_ADDR } },
+    { "ld",    INST_LD_VX_VY,     0x8000,  { OPERAND_VX, OPERAND_VY } },
+    { "ld",    INST_LD_VX_DT,     0xf007,  { OPERAND_VX, OPERAND_DT } },
+    { "ld",    INST_LD_VX_I,      0xf065,  { OPERAND_VX, OPERAND_I_INDIRECT } },
+    { "ld",    INST_LD_VX_N,      0xf00a,  { OPERAND_VX, OPERAND_K } },
+    { "ld",    INST_LD_VX_NN,     0x6000,  { OPERAND_VX, OPERAND_NN } },
+    { "ld",    INST_LD_I_ADDR,    0xa000,  { OPERAND_I, OPERAND_ADDR } },
+    { "ld",    INST_LD_B_VX,      0xf033,  { OPERAND_B, OPERAND_VX } },
+    { "ld",    INST_LD_DT_VX,     0xf015,  { OPERAND_DT, OPERAND_VX } },
+    { "ld",    INST_LD_F_VX,      0xf029,  { OPERAND_F, OPERAND_VX } },
+    { "ld",    INST_LD_I_VX,      0xf055,  { OPERAND_I_INDIRECT, OPERAND_VX } },
+    { "ld",    INST_LD_ST_VX,     0xf018,  { OPERAND_ST, OPERAND_VX } },
+    { "or",    INST_OR_VX_VY,     0x8001,  { OPERAND_VX, OPERAND_VY } },
+    { "ret",   INST_RET,          0x00ee,  {} },
+    { "rnd",   INST_RND_VX_NN,    0xc000,  { OPERAND_VX, OPERAND_NN } },
+    { "se",    INST_SE_VX_VY,     0x5000,  { OPERAND_VX, OPERAND_VY } },
+    { "se",    INST_SE_VX_NN,     0x3000,  { OPERAND_VX, OPERAND_NN } },
+    { "shl",   INST_SHL_VX_VY,    0x800e,  { OPERAND_VX } },
+    { "shr",   INST_SHR_VX_VY,    0x8006,  { OPERAND_VX } },
+    { "sknp",  INST_SKNP_VX,      0xe0a1,  { OPERAND_VX } },
+    { "skp",   INST_SKP_VX,       0xe09e,  { OPERAND_VX } },
+    { "sne",   INST_SNE_VX_VY,    0x9000,  { OPERAND_VX, OPERAND_VY } },
+    { "sne",   INST_SNE_VX_NN,    0x4000,  { OPERAND_VX, OPERAND_NN } },
+    { "sub",   INST_SUB_VX_VY,    0x8005,  { OPERAND_VX, OPERAND_VY } },
+    { "subn",  INST_SUBN_VX_VY,   0x8007,  { OPERAND_VX, OPERAND_VY } },
+    { "xor",   INST_XOR_VX_VY,    0x8003,  { OPERAND_VX, OPERAND_VY } }
+};
+
+inline constexpr int INSTRUCTION_FORM_COUNT = sizeof(g_instructionForms) / sizeof(g_instructionForms[0]);
+
+
+// where each field of an instruction goes in its encoding; the operand mask
+// doubles as the largest value the parser accepts for the immediate
+struct InstructionEncoding
+{
+    uint16_t opcode;
+    uint16_t registerMask;   // 0x0f00 when it takes vx, plus 0x00f0 for vy
+    uint16_t operandMask;    // n, nn, an address or a data value
+    uint8_t size;            // in bytes, 0 for an instruction with no form or a data block
+};
+
+
+struct InstructionEncodingTable
+{
+    InstructionEncoding encodings[INST_COUNT];
+    bool valid;
+};
+
+
+constexpr InstructionEncodingTable buildInstructionEncodings()
+{
+    InstructionEncodingTable table = {};
+    table.valid = true;
+    
+    // data has no form; its value is the whole encoding
+    table.encodings[INST_DEFINEBYTE] = { 0x0000, 0x0000, 0x00ff, 1 };
+    table.encodings[INST_DEFINEWORD] = { 0x0000, 0x0000, 0xffff, 2 };
+    
+    for(int index = 0; index < INSTRUCTION_FORM_COUNT; ++index)
+    {
+        const InstructionForm& form = g_instructionForms[index];
+        InstructionEncoding encoding = { form.opcode, 0x0000, 0x0000, 2 };
+        
+        for(int operand = 0; operand < form.operandCount(); ++operand)
+        {
+            switch(form.operands[operand])
+            {
+                case OPERAND_VX:    encoding.registerMask |= 0x0f00;  break;
+                case OPERAND_VY:    encoding.registerMask |= 0x00f0;  break;
+                case OPERAND_N:     encoding.operandMask |= 0x000f;   break;
+                case OPERAND_NN:    encoding.operandMask |= 0x00ff;   break;
+                case OPERAND_ADDR:  encoding.operandMask |= 0x0fff;   break;
+            }
+        }
+        
+        // fields may not overlap each other or the opcode, and each
+        // instruction has exactly one form
+        if((encoding.registerMask & encoding.operandMask)  ||
+            (encoding.opcode & (encoding.registerMask | encoding.operandMask))  ||
+            table.encodings[form.instruction].size)
+        {
+            table.valid = false;
+        }
+        
+        table.encodings[form.instruction] = encoding;
+    }
+    
+    // a data block is copied rather than encoded, and its size is its own
+    for(int instruction = 0; instruction < INST_COUNT; ++instruction)
+    {
+        if(!table.encodings[instruction].size  &&  instruction != INST_DATABLOCK)
+            table.valid = false;
+    }
+    
+    return table;
+}
+
+
+inline constexpr InstructionEncodingTable g_instructionEncodings = buildInstructionEncodings();
+
+static_assert(g_instructionEncodings.valid, "an instruction has no form, two forms, or fields that overlap");
+
+
+// the whole encoder: unused fields are masked away, so there is nothing to
+// branch on
+constexpr uint16_t encodeInstruction(int instruction, int x, int y, uint32_t operand)
+{
+    const InstructionEncoding& encoding = g_instructionEncodings.encodings[instruction];
+    
+    return encoding.opcode | (((x << 8) | (y << 4)) & encoding.registerMask) | (operand & encoding.operandMask);
+}
+
+
+// the table against the encodings in the chip-8 reference
+static_assert(encodeInstruction(INST_DEFINEBYTE,  0, 0, 0x12)   == 0x0012);
+static_assert(encodeInstruction(INST_DEFINEWORD,  0, 0, 0x1234) == 0x1234);
+static_assert(encodeInstruction(INST_CLS,         0, 0, 0)      == 0x00e0);
+static_assert(encodeInstruction(INST_RET,         0, 0, 0)      == 0x00ee);
+static_assert(encodeInstruction(INST_JP_ADDR,     0, 0, 0x345)  == 0x1345);
+static_assert(encodeInstruction(INST_CALL_ADDR,   0, 0, 0x345)  == 0x2345);
+static_assert(encodeInstruction(INST_SE_VX_NN,    1, 0, 0x23)   == 0x3123);
+static_assert(encodeInstruction(INST_SNE_VX_NN,   1, 0, 0x23)   == 0x4123);
+static_assert(encodeInstruction(INST_SE_VX_VY,    1, 2, 0)      == 0x5120);
+static_assert(encodeInstruction(INST_LD_VX_NN,    1, 0, 0x23)   == 0x6123);
+static_assert(encodeInstruction(INST_ADD_VX_NN,   1, 0, 0x23)   == 0x7123);
+static_assert(encodeInstruction(INST_LD_VX_VY,    1, 2, 0)      == 0x8120);
+static_assert(encodeInstruction(INST_OR_VX_VY,    1, 2, 0)      == 0x8121);
+static_assert(encodeInstruction(INST_AND_VX_VY,   1, 2, 0)      == 0x8122);
+static_assert(encodeInstruction(INST_XOR_VX_VY,   1, 2, 0)      == 0x8123);
+static_assert(encodeInstruction(INST_ADD_VX_VY,   1, 2, 0)      == 0x8124);
+static_assert(encodeInstruction(INST_SUB_VX_VY,   1, 2, 0)      == 0x8125);
+static_assert(encodeInstruction(INST_SHR_VX_VY,   1, 0, 0)      == 0x8106);
+static_assert(encodeInstruction(INST_SUBN_VX_VY,  1, 2, 0)      == 0x8127);
+static_assert(encodeInstruction(INST_SHL_VX_VY,   1, 0, 0)      == 0x810e);
+static_assert(encodeInstruction(INST_SNE_VX_VY,   1, 2, 0)      == 0x9120);
+static_assert(encodeInstruction(INST_LD_I_ADDR,   0, 0, 0x345)  == 0xa345);
+static_assert(encodeInstruction(INST_JP_V0_ADDR,  0, 0, 0x345)  == 0xb345);
+static_assert(encodeInstruction(INST_RND_VX_NN,   1, 0, 0x23)   == 0xc123);
+static_assert(encodeInstruction(INST_DRW_VX_VY_N, 1, 2, 3)      == 0xd123);
+static_assert(encodeInstruction(INST_SKP_VX,      1, 0, 0)      == 0xe19e);
+static_assert(encodeInstruction(INST_SKNP_VX,     1, 0, 0)      == 0xe1a1);
+static_assert(encodeInstruction(INST_LD_VX_DT,    1, 0, 0)      == 0xf107);
+static_assert(encodeInstruction(INST_LD_VX_N,     1, 0, 0)      == 0xf10a);
+static_assert(encodeInstruction(INST_LD_DT_VX,    1, 0, 0)      == 0xf115);
+static_assert(encodeInstruction(INST_LD_ST_VX,    1, 0, 0)      == 0xf118);
+static_assert(encodeInstruction(INST_ADD_I_VX,    1, 0, 0)      == 0xf11e);
+static_assert(encodeInstruction(INST_LD_F_VX,     1, 0, 0)      == 0xf129);
+static_assert(encodeInstruction(INST_LD_B_VX,     1, 0, 0)      == 0xf133);
+static_assert(encodeInstruction(INST_LD_I_VX,     1, 0, 0)      == 0xf155);
+static_assert(encodeInstruction(INST_LD_VX_I,     1, 0, 0)      == 0xf165);
+
+
+// the encoder run backwards for the interpreter: the instruction whose
+// opcode matches once its fields are masked away, or INST_COUNT for none.
+// the shifts ignore vy, as the interpreters that shift vx in place do
+constexpr int decodeInstruction(uint16_t word)
+{
+    for(int instruction = INST_CLS; instruction < INST_COUNT; ++instruction)
+    {
+        const InstructionEncoding& encoding = g_instructionEncodings.encodings[instruction];
+        uint16_t fields = encoding.registerMask | encoding.operandMask;
+        
+        if((encoding.opcode & 0xf000) == 0x8000)
+            fields |= 0x00f0;
+        
+        if((word & ~fields) == encoding.opcode)
+            return instruction;
+    }
+    
+    return INST_COUNT;
+}
+
+
+// every instruction decodes back to itself
+constexpr bool decodesEveryInstruction()
+{
+    for(int instruction = INST_CLS; instruction < INST_COUNT; ++instruction)
+    {
+        if(decodeInstruction(encodeInstruction(instruction, 1, 2, 0x345)) != instruction)
+            return false;
+    }
+    
+    return true;
+}
+
+static_assert(decodesEveryInstruction(), "two instructions share an encoding");
+static_assert(decodeInstruction(0x0123) == INST_COUNT);
+static_assert(decodeInstruction(0x8126) == INST_SHR_VX_VY);
+
+
+// a statement packed into eight trivially copyable bytes; the operand holds
+// the immediate (nn, n, address or data value), the index of a data block,
+// or, when STATEMENT_SYMBOL is set, the id of the label to resolve, and when
+// STATEMENT_EXPRESSION is set, the index of the expression to evaluate
+inline constexpr uint32_t STATEMENT_SYMBOL = 0x80000000;
+inline constexpr uint32_t STATEMENT_EXPRESSION = 0x40000000;
+
+struct Statement
+{
+    uint8_t instruction;
+    uint8_t x : 4;
+    uint8_t y : 4;
+    uint16_t offset;
+    uint32_t operand;
+};
+
+static_assert(sizeof(Statement) == 8, "Statement should pack into eight bytes");
+static_assert(std::is_trivially_copyable<Statement>::value, "Statement should be trivially copyable");
+
+
+// the size of a data block is kept with the block, see statementSize() in
+// context.h
+constexpr int statementSize(const Statement& statement)
+{
+    return g_instructionEncodings.encodings[statement.instruction].size;
+}
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,618 @@
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "scanner.h"
+
+// labels as values; other compilers dispatch through a switch instead
+#if defined(__GNUC__)
+#define CHIP8ASM_COMPUTED_GOTO
+#endif
+
+
+namespace chip8asm
+{
+
+
+namespace
+{
+
+// the hex digits ld f, vx points i at, five rows each
+const uint8_t g_font[16 * 5] =
+{
+    0xf0, 0x90, 0x90, 0x90, 0xf0,
+    0x20, 0x60, 0x20, 0x20, 0x70,
+    0xf0, 0x10, 0xf0, 0x80, 0xf0,
+    0xf0, 0x10, 0xf0, 0x10, 0xf0,
+    0x90, 0x90, 0xf0, 0x10, 0x10,
+    0xf0, 0x80, 0xf0, 0x10, 0xf0,
+    0xf0, 0x80, 0xf0, 0x90, 0xf0,
+    0xf0, 0x10, 0x20, 0x40, 0x40,
+    0xf0, 0x90, 0xf0, 0x90, 0xf0,
+    0xf0, 0x90, 0xf0, 0x10, 0xf0,
+    0xf0, 0x90, 0xf0, 0x90, 0x90,
+    0xe0, 0x90, 0xe0, 0x90, 0xe0,
+    0xf0, 0x80, 0x80, 0x80, 0xf0,
+    0xe0, 0x90, 0x90, 0x90, 0xe0,
+    0xf0, 0x80, 0xf0, 0x80, 0xf0,
+    0xf0, 0x80, 0xf0, 0x80, 0x80
+};
+
+constexpr int ADDRESS_MASK = MACHINE_MEMORY_SIZE - 1;
+
+}  // namespace
+
+
+//
+//
+//
+
+Interpreter::Interpreter(int instructionsPerTick, uint32_t seed)
+    : m_seed(seed ? seed : 1), m_instructionsPerTick(std::max(instructionsPerTick, 1))
+{
+    load(std::vector<uint8_t>(), PROGRAM_START);
+}
+
+
+//
+//
+//
+
+bool Interpreter::load(const std::vector<uint8_t>& image, uint16_t origin)
+{
+    if(origin + image.size() > MACHINE_MEMORY_SIZE)
+        return false;
+    
+    memset(m_memory, 0, sizeof(m_memory));
+    memcpy(m_memory, g_font, sizeof(g_font));
+    
+    if(!image.empty())
+        memcpy(m_memory + origin, image.data(), image.size());
+    
+    memset(m_screen, 0, sizeof(m_screen));
+    memset(m_v, 0, sizeof(m_v));
+    memset(m_stack, 0, sizeof(m_stack));
+    
+    m_i = 0;
+    m_pc = PROGRAM_START;
+    m_stackDepth = 0;
+    m_delayTimer = 0;
+    m_soundTimer = 0;
+    m_keys = 0;
+    m_random = m_seed;
+    m_redraw = true;
+    m_executed = 0;
+    m_error.clear();
+    
+    for(int address = 0; address < MACHINE_MEMORY_SIZE; ++address)
+        decode(address);
+    
+    // a pc that runs off the end, by stepping or skipping, carries on at the
+    // start the way a 12-bit program counter would
+    for(int address = MACHINE_MEMORY_SIZE; address < MACHINE_MEMORY_SIZE + 4; ++address)
+        m_decoded[address] = { HANDLER_WRAP, 0, 0, 0 };
+    
+    return true;
+}
+
+
+//
+// ticks the timers at every multiple of instructionsPerTick; with both
+// timers stopped a tick changes nothing, so a run goes straight past them
+//
+
+int Interpreter::run(uint64_t count)
+{
+    while(count > 0)
+    {
+        uint64_t batch = count;
+        uint64_t executed = 0;
+        
+        if(m_delayTimer  ||  m_soundTimer)
+            batch = std::min(count, tickAfter(m_executed + 1) - m_executed);
+        
+        int status = execute(batch, executed);
+        
+        m_executed += executed;
+        count -= executed;
+        
+        if(executed  &&  m_executed % m_instructionsPerTick == 0)
+            tick();
+        
+        if(status != RUN_LIMIT)
+            return status;
+    }
+    
+    return RUN_LIMIT;
+}
+
+
+//
+//
+//
+
+bool Interpreter::takeRedraw()
+{
+    bool redraw = m_redraw;
+    
+    m_redraw = false;
+    return redraw;
+}
+
+
+//
+// the inner loop: each handler does its work and jumps straight to the
+// handler of the next instruction, counting down count as it goes
+//
+
+#ifdef CHIP8ASM_COMPUTED_GOTO
+#define HANDLER(name)  handle_##name
+#define REDISPATCH()   goto *handlers[op->handler]
+#else
+#define HANDLER(name)  case name
+#define REDISPATCH()   continue
+#endif
+
+#define DISPATCH()  { if(--remaining == 0) goto stop; REDISPATCH(); }
+
+int Interpreter::execute(uint64_t count, uint64_t& executed)
+{
+#ifdef CHIP8ASM_COMPUTED_GOTO
+    // in InstructionEnum order, then HandlerEnum's; data is never decoded
+    static const void *const handlers[] =
+    {
+        &&handle_HANDLER_INVALID,
+        &&handle_HANDLER_INVALID,
+        &&handle_HANDLER_INVALID,
+        
+        &&handle_INST_CLS,
+        &&handle_INST_RET,
+        &&handle_INST_JP_ADDR,
+        &&handle_INST_CALL_ADDR,
+        &&handle_INST_SE_VX_NN,
+        &&handle_INST_SNE_VX_NN,
+        &&handle_INST_SE_VX_VY,
+        &&handle_INST_LD_VX_NN,
+        &&handle_INST_ADD_VX_NN,
+        &&handle_INST_LD_VX_VY,
+        &&handle_INST_OR_VX_VY,
+        &&handle_INST_AND_VX_VY,
+        &&handle_INST_XOR_VX_VY,
+        &&handle_INST_ADD_VX_VY,
+        &&handle_INST_SUB_VX_VY,
+        &&handle_INST_SHR_VX_VY,
+        &&handle_INST_SUBN_VX_VY,
+        &&handle_INST_SHL_VX_VY,
+        &&handle_INST_SNE_VX_VY,
+        &&handle_INST_LD_I_ADDR,
+        &&handle_INST_JP_V0_ADDR,
+        &&handle_INST_RND_VX_NN,
+        &&handle_INST_DRW_VX_VY_N,
+        &&handle_INST_SKP_VX,
+        &&handle_INST_SKNP_VX,
+        &&handle_INST_LD_VX_DT,
+        &&handle_INST_LD_VX_N,
+        &&handle_INST_LD_DT_VX,
+        &&handle_INST_LD_ST_VX,
+        &&handle_INST_ADD_I_VX,
+        &&handle_INST_LD_F_VX,
+        &&handle_INST_LD_B_VX,
+        &&handle_INST_LD_I_VX,
+        &&handle_INST_LD_VX_I,
+        
+        &&handle_HANDLER_INVALID,
+        &&handle_HANDLER_HALT,
+        &&handle_HANDLER_WRAP
+    };
+    
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == HANDLER_COUNT, "every handler needs a label");
+#endif
+    
+    const DecodedInstruction *op = m_decoded + m_pc;
+    uint8_t *v = m_v;
+    uint8_t *memory = m_memory;
+    uint64_t *screen = m_screen;
+    uint16_t i = m_i;
+    uint64_t remaining = count;
+    int status = RUN_LIMIT;
+    
+    if(remaining == 0)
+        goto stop;
+
+#ifdef CHIP8ASM_COMPUTED_GOTO
+    REDISPATCH();
+#else
+    for(;;)
+    {
+        switch(op->handler)
+        {
+#endif
+    
+    HANDLER(INST_CLS):
+        memset(screen, 0, sizeof(m_screen));
+        m_redraw = true;
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_RET):
+        if(m_stackDepth == 0)
+        {
+            status = fail(op, "ret with nothing to return to");
+            goto stop;
+        }
+        
+        op = m_decoded + m_stack[--m_stackDepth];
+        DISPATCH();
+    
+    HANDLER(INST_JP_ADDR):
+        op = m_decoded + op->operand;
+        DISPATCH();
+    
+    HANDLER(INST_CALL_ADDR):
+        if(m_stackDepth == 16)
+        {
+            status = fail(op, "calls nest more than 16 deep");
+            goto stop;
+        }
+        
+        m_stack[m_stackDepth++] = (uint16_t) (op - m_decoded + 2);
+        op = m_decoded + op->operand;
+        DISPATCH();
+    
+    HANDLER(INST_SE_VX_NN):
+        op += v[op->x] == op->operand ? 4 : 2;
+        DISPATCH();
+    
+    HANDLER(INST_SNE_VX_NN):
+        op += v[op->x] != op->operand ? 4 : 2;
+        DISPATCH();
+    
+    HANDLER(INST_SE_VX_VY):
+        op += v[op->x] == v[op->y] ? 4 : 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_VX_NN):
+        v[op->x] = (uint8_t) op->operand;
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_ADD_VX_NN):
+        v[op->x] += (uint8_t) op->operand;
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_VX_VY):
+        v[op->x] = v[op->y];
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_OR_VX_VY):
+        v[op->x] |= v[op->y];
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_AND_VX_VY):
+        v[op->x] &= v[op->y];
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_XOR_VX_VY):
+        v[op->x] ^= v[op->y];
+        op += 2;
+        DISPATCH();
+    
+    // the flag is written after the result, so it wins when x is vf
+    HANDLER(INST_ADD_VX_VY):
+    {
+        int sum = v[op->x] + v[op->y];
+        
+        v[op->x] = (uint8_t) sum;
+        v[15] = (uint8_t) (sum >> 8);
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SUB_VX_VY):
+    {
+        uint8_t flag = v[op->x] >= v[op->y];
+        
+        v[op->x] -= v[op->y];
+        v[15] = flag;
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SHR_VX_VY):
+    {
+        uint8_t flag = v[op->x] & 1;
+        
+        v[op->x] >>= 1;
+        v[15] = flag;
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SUBN_VX_VY):
+    {
+        uint8_t flag = v[op->y] >= v[op->x];
+        
+        v[op->x] = v[op->y] - v[op->x];
+        v[15] = flag;
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SHL_VX_VY):
+    {
+        uint8_t flag = v[op->x] >> 7;
+        
+        v[op->x] <<= 1;
+        v[15] = flag;
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SNE_VX_VY):
+        op += v[op->x] != v[op->y] ? 4 : 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_I_ADDR):
+        i = op->operand;
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_JP_V0_ADDR):
+        op = m_decoded + ((op->operand + v[0]) & ADDRESS_MASK);
+        DISPATCH();
+    
+    HANDLER(INST_RND_VX_NN):
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        v[op->x] = (uint8_t) (m_random & op->operand);
+        op += 2;
+        DISPATCH();
+    
+    // each sprite row lands in a screen row with one shift and one xor;
+    // rows below the screen and pixels right of it are clipped
+    HANDLER(INST_DRW_VX_VY_N):
+    {
+        int x = v[op->x] & (SCREEN_WIDTH - 1);
+        int y = v[op->y] & (SCREEN_HEIGHT - 1);
+        int rows = std::min<int>(op->operand, SCREEN_HEIGHT - y);
+        uint64_t collision = 0;
+        
+        for(int row = 0; row < rows; ++row)
+        {
+            uint64_t bits = (uint64_t) memory[(i + row) & ADDRESS_MASK] << 56 >> x;
+            
+            collision |= screen[y + row] & bits;
+            screen[y + row] ^= bits;
+        }
+        
+        v[15] = collision != 0;
+        m_redraw = true;
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_SKP_VX):
+        op += (m_keys >> (v[op->x] & 15)) & 1 ? 4 : 2;
+        DISPATCH();
+    
+    HANDLER(INST_SKNP_VX):
+        op += (m_keys >> (v[op->x] & 15)) & 1 ? 2 : 4;
+        DISPATCH();
+    
+    HANDLER(INST_LD_VX_DT):
+        v[op->x] = m_delayTimer;
+        op += 2;
+        DISPATCH();
+    
+    // waiting for a key spends the instructions up to the next tick, so the
+    // timers still run down while it waits
+    HANDLER(INST_LD_VX_N):
+        if(!m_keys)
+        {
+            stopAtTick(count, remaining);
+            status = RUN_WAITING;
+            remaining = 0;
+            goto stop;
+        }
+        
+        v[op->x] = (uint8_t) countTrailingZeros(m_keys);
+        op += 2;
+        DISPATCH();
+    
+    // a timer that starts mid-run ends the run at the next tick
+    HANDLER(INST_LD_DT_VX):
+        m_delayTimer = v[op->x];
+        
+        if(m_delayTimer)
+            stopAtTick(count, remaining);
+        
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_ST_VX):
+        m_soundTimer = v[op->x];
+        
+        if(m_soundTimer)
+            stopAtTick(count, remaining);
+        
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_ADD_I_VX):
+        i += v[op->x];
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_F_VX):
+        i = (v[op->x] & 15) * 5;
+        op += 2;
+        DISPATCH();
+    
+    // stores decode what they wrote again, so a program may rewrite itself
+    HANDLER(INST_LD_B_VX):
+    {
+        uint8_t value = v[op->x];
+        
+        memory[i & ADDRESS_MASK] = value / 100;
+        memory[(i + 1) & ADDRESS_MASK] = value / 10 % 10;
+        memory[(i + 2) & ADDRESS_MASK] = value % 10;
+        decodeRange(i, 3);
+        op += 2;
+        DISPATCH();
+    }
+    
+    HANDLER(INST_LD_I_VX):
+        for(int index = 0; index <= op->x; ++index)
+            memory[(i + index) & ADDRESS_MASK] = v[index];
+        
+        decodeRange(i, op->x + 1);
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(INST_LD_VX_I):
+        for(int index = 0; index <= op->x; ++index)
+            v[index] = memory[(i + index) & ADDRESS_MASK];
+        
+        op += 2;
+        DISPATCH();
+    
+    HANDLER(HANDLER_INVALID):
+#ifndef CHIP8ASM_COMPUTED_GOTO
+    default:
+#endif
+    {
+        char message[64];
+        
+        snprintf(message, sizeof(message), "unknown instruction $%04x", op->operand);
+        status = fail(op, message);
+        goto stop;
+    }
+    
+    HANDLER(HANDLER_HALT):
+        status = RUN_HALTED;
+        goto stop;
+    
+    HANDLER(HANDLER_WRAP):
+        op -= MACHINE_MEMORY_SIZE;
+        REDISPATCH();
+
+#ifndef CHIP8ASM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+stop:
+    m_pc = (uint16_t) (op - m_decoded);
+    m_i = i;
+    executed = count - remaining;
+    return status;
+}
+
+#undef HANDLER
+#undef REDISPATCH
+#undef DISPATCH
+
+
+//
+// decodes the instruction at address; a jump to itself becomes a halt so
+// a program that ends that way stops rather than spins
+//
+
+void Interpreter::decode(int address)
+{
+    uint16_t word = (m_memory[address] << 8) | m_memory[(address + 1) & ADDRESS_MASK];
+    int instruction = decodeInstruction(word);
+    DecodedInstruction& decoded = m_decoded[address];
+    
+    // an unknown word is kept whole for the error
+    if(instruction == INST_COUNT)
+    {
+        decoded = { HANDLER_INVALID, 0, 0, word };
+        return;
+    }
+    
+    const InstructionEncoding& encoding = g_instructionEncodings.encodings[instruction];
+    
+    decoded.handler = (uint8_t) instruction;
+    decoded.x = (word >> 8) & 15;
+    decoded.y = (word >> 4) & 15;
+    decoded.operand = word & encoding.operandMask;
+    
+    if(instruction == INST_JP_ADDR  &&  decoded.operand == address)
+        decoded.handler = HANDLER_HALT;
+}
+
+
+//
+// decodes again the addresses a write of size bytes at address touched,
+// and the one before, whose second byte it may have been
+//
+
+void Interpreter::decodeRange(int address, int size)
+{
+    for(int index = -1; index < size; ++index)
+        decode((address + index) & ADDRESS_MASK);
+}
+
+
+//
+//
+//
+
+void Interpreter::tick()
+{
+    if(m_delayTimer)
+        --m_delayTimer;
+    
+    if(m_soundTimer)
+        --m_soundTimer;
+}
+
+
+//
+// ends the run of count instructions at the next tick, remaining of them
+// still to go counting the one running now
+//
+
+void Interpreter::stopAtTick(uint64_t& count, uint64_t& remaining) const
+{
+    uint64_t done = m_executed + count - remaining + 1;
+    uint64_t cut = remaining - std::min(remaining, tickAfter(done) - done + 1);
+    
+    count -= cut;
+    remaining -= cut;
+}
+
+
+//
+// the first tick at or after the given instruction count
+//
+
+uint64_t Interpreter::tickAfter(uint64_t executed) const
+{
+    return (executed + m_instructionsPerTick - 1) / m_instructionsPerTick * m_instructionsPerTick;
+}
+
+
+//
+//
+//
+
+int Interpreter::fail(const DecodedInstruction *op, const char *message)
+{
+    char text[128];
+    
+    snprintf(text, sizeof(text), "%s at $%03x", message, (int) (op - m_decoded));
+    m_error = text;
+    return RUN_ERROR;
+}
+
+
+}  // namespace chip8asm
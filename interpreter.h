@@ -0,0 +1,121 @@
+#ifndef CHIP8ASM_INTERPRETER_H
+#define CHIP8ASM_INTERPRETER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "instructions.h"
+
+
+namespace chip8asm
+{
+
+
+// the cosmac vip's 4 KiB, with the font at the bottom and programs loaded
+// at $200, and its 64x32 screen
+inline constexpr int MACHINE_MEMORY_SIZE = 0x1000;
+inline constexpr int PROGRAM_START = 0x0200;
+inline constexpr int SCREEN_WIDTH = 64;
+inline constexpr int SCREEN_HEIGHT = 32;
+
+
+enum RunStatusEnum
+{
+    RUN_LIMIT,               // ran every instruction it was asked to
+    RUN_HALTED,              // reached a jump to itself, which nothing leaves
+    RUN_WAITING,             // ld vx, k with no key held
+    RUN_ERROR                // error() says why
+};
+
+
+// handlers besides the instructions' own
+enum HandlerEnum
+{
+    HANDLER_INVALID = INST_COUNT,    // a word no instruction encodes to
+    HANDLER_HALT,                    // jp to its own address
+    HANDLER_WRAP,                    // past the end of memory, back to the start
+    
+    HANDLER_COUNT
+};
+
+
+// one address predecoded into its handler and the fields it reads. a
+// handler index rather than a pointer keeps an entry at six bytes, so every
+// address of the machine decodes into 24 KiB that stay in the l1 cache
+struct DecodedInstruction
+{
+    uint8_t handler;
+    uint8_t x;
+    uint8_t y;
+    uint16_t operand;        // nn, n or an address
+};
+
+
+// runs an assembled image. every address is decoded once, when it is loaded
+// or written, so the inner loop goes straight from one handler to the next.
+// the delay and sound timers tick once every instructionsPerTick
+// instructions, which stands in for 60 Hz; a run is therefore the same
+// however fast the host is. the quirks are those of the later interpreters:
+// the shifts work on vx alone, and ld [i] and ld vx, [i] leave i as it was
+class Interpreter
+{
+public:
+    explicit Interpreter(int instructionsPerTick = 10, uint32_t seed = 1);
+    
+    // resets the machine and loads the image at origin; false if it does not
+    // fit in memory
+    bool load(const std::vector<uint8_t>& image, uint16_t origin);
+    
+    // executes up to count instructions
+    int run(uint64_t count);
+    
+    // keys 0 to f held down, bit n for key n
+    void setKeys(uint16_t keys)  { m_keys = keys; }
+    
+    // row y of the screen has pixel x in bit 63 - x
+    const uint64_t *screen() const  { return m_screen; }
+    
+    // whether cls or drw ran since the last call
+    bool takeRedraw();
+    
+    bool soundOn() const  { return m_soundTimer != 0; }
+    uint16_t pc() const  { return m_pc; }
+    uint64_t executed() const  { return m_executed; }
+    const std::string& error() const  { return m_error; }
+
+private:
+    int execute(uint64_t count, uint64_t& executed);
+    void decode(int address);
+    void decodeRange(int address, int size);
+    void tick();
+    void stopAtTick(uint64_t& count, uint64_t& remaining) const;
+    uint64_t tickAfter(uint64_t executed) const;
+    int fail(const DecodedInstruction *op, const char *message);
+    
+    DecodedInstruction m_decoded[MACHINE_MEMORY_SIZE + 4];
+    uint8_t m_memory[MACHINE_MEMORY_SIZE];
+    uint64_t m_screen[SCREEN_HEIGHT];
+    
+    uint8_t m_v[16];
+    uint16_t m_i = 0;
+    uint16_t m_pc = PROGRAM_START;
+    uint16_t m_stack[16];
+    int m_stackDepth = 0;
+    uint8_t m_delayTimer = 0;
+    uint8_t m_soundTimer = 0;
+    uint16_t m_keys = 0;
+    uint32_t m_random;
+    bool m_redraw = false;
+    
+    uint32_t m_seed;
+    int m_instructionsPerTick;
+    uint64_t m_executed = 0;
+    std::string m_error;
+};
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -1,119 +1,87 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
-#include <fstream>
-#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include "chip8asm.h"
+#include "context.h"
+#include "incremental.h"
+#include "interpreter.h"
+#include "server.h"
+#include "source.h"
+#include "threadpool.h"
+#include "tokenizer.h"
 
-enum InstructionEnum
-{
-    INST_DEFINEBYTE,
-    INST_DEFINEWORD,
-
-    INST_CLS,
-    INST_RET,
-    INST_JP_ADDR,
-    INST_CALL_ADDR,
-    INST_SE_VX_NN,
-    INST_SNE_VX_NN,
-    INST_SE_VX_VY,
-    INST_LD_VX_NN,
-    INST_ADD_VX_NN,
-    INST_LD_VX_VY,
-    INST_OR_VX_VY,
-    INST_AND_VX_VY,
-    INST_XOR_VX_VY,
-    INST_ADD_VX_VY,
-    INST_SUB_VX_VY,
-    INST_SHR_VX_VY,
-    INST_SUBN_VX_VY,
-    INST_SHL_VX_VY,
-    INST_SNE_VX_VY,
-    INST_LD_I_ADDR,
-    INST_JP_V0_ADDR,
-    INST_RND_VX_NN,
-    INST_DRW_VX_VY_N,
-    INST_SKP_VX,
-    INST_SKNP_VX,
-    INST_LD_VX_DT,
-    INST_LD_VX_N,
-    INST_LD_DT_VX,
-    INST_LD_ST_VX,
-    INST_ADD_I_VX,
-    INST_LD_F_VX,
-    INST_LD_B_VX,
-    INST_LD_I_VX,
-    INST_LD_VX_I
-};
+#ifdef CHIP8ASM_POSIX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
-enum RegisterEnum
-{
-    REG_V0,
-    REG_V1,
-    REG_V2,
-    REG_V3,
-    REG_V4,
-    REG_V5,
-    REG_V6,
-    REG_V7,
-    REG_V8,
-    REG_V9,
-    REG_VA,
-    REG_VB,
-    REG_VC,
-    REG_VD,
-    REG_VE,
-    REG_VF,
-    REG_B,
-    REG_DT,
-    REG_F,
-    REG_I,
-    REG_I_INDIRECT,
-    REG_K,
-    REG_ST
-};
 
+using chip8asm::Clock;
+using chip8asm::secondsSince;
 
-struct Statement
+
+// count every heap allocation, so --stats can show whether the hot path
+// makes any
+std::atomic<size_t> g_allocationCount;
+
+
+void *operator new(size_t size)
 {
-    uint8_t instruction;
-    uint8_t size;
-    uint16_t offset;
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
     
-    uint16_t value;
+    if(void *memory = malloc(size ? size : 1))
+        return memory;
     
-    uint8_t x;
-    uint8_t y;
-    uint8_t n;
-    uint8_t nn;
-    std::string address;
-};
+    throw std::bad_alloc();
+}
 
 
-struct Token
+void operator delete(void *memory) noexcept
 {
-    int column;
-    std::string text;
-};
+    free(memory);
+}
 
 
-// global variables
-std::map<std::string, int> g_symbolTable;
-std::vector<Statement> g_statements;
-int g_lineNumber;
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+
+// "-" in place of an input or output filename means standard input or output
+bool isStandardStream(const std::string& filename)
+{
+    return filename == "-";
+}
 
 
 //
-//
+// relative .incbin paths in a source start in its directory, or in the
+// working directory for standard input
 //
 
-std::string trim(const std::string& text)
+std::string sourceDirectory(const std::string& inputFilename)
 {
-    size_t first = text.find_first_not_of(" \f\n\r\t\v");
-    size_t last = text.find_last_not_of(" \f\n\r\t\v");
-
-    return std::string(text.begin() + first, text.begin() + last + 1);
+    return isStandardStream(inputFilename) ? std::string() : std::filesystem::path(inputFilename).parent_path().string();
 }
 
 
@@ -121,21 +89,64 @@ std::string trim(const std::string& text)
 //
 //
 
-bool parseInteger(std::string& text, int& result, int maxValue = 0)
+bool writeImage(const std::string& outputFilename, const std::vector<uint8_t>& image, size_t& writeCount)
 {
-    text = trim(text);
+#ifdef CHIP8ASM_POSIX
+    bool standardOutput = isStandardStream(outputFilename);
+    int descriptor = standardOutput ? STDOUT_FILENO : open(outputFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
     
-    if(text[0] == '$')
-        result = (int) strtol(text.data() + 1, NULL, 16);
-    else if(text[0] == '%')
-        result = (int) strtol(text.data() + 1, NULL, 2);
-    else
-        result = (int) strtol(text.data(), NULL, 0);
-
-    if(maxValue  &&  result > maxValue)
+    if(descriptor == -1)
+    {
+        fprintf(stderr, "error opening output file \"%s\"\n", outputFilename.c_str());
         return false;
+    }
     
-    return true;
+    // a single write normally covers the whole image, but regular files may
+    // still return short counts and pipes take at most what fits in them
+    size_t written = 0;
+    
+    while(written < image.size())
+    {
+        ssize_t count = write(descriptor, image.data() + written, image.size() - written);
+        ++writeCount;
+        
+        if(count < 0  &&  errno == EINTR)
+            continue;
+        
+        if(count < 0)
+        {
+            if(!standardOutput)
+                close(descriptor);
+            
+            return false;
+        }
+        
+        written += count;
+    }
+    
+    return standardOutput  ||  close(descriptor) == 0;
+#else
+    if(isStandardStream(outputFilename))
+    {
+        size_t written = fwrite(image.data(), 1, image.size(), stdout);
+        ++writeCount;
+        
+        return fflush(stdout) == 0  &&  written == image.size();
+    }
+    
+    FILE *file = fopen(outputFilename.c_str(), "wb");
+    
+    if(!file)
+    {
+        fprintf(stderr, "error opening output file \"%s\"\n", outputFilename.c_str());
+        return false;
+    }
+    
+    size_t written = fwrite(image.data(), 1, image.size(), file);
+    ++writeCount;
+    
+    return fclose(file) == 0  &&  written == image.size();
+#endif
 }
 
 
@@ -143,60 +154,21 @@ bool parseInteger(std::string& text, int& result, int maxValue = 0)
 //
 //
 
-bool parseRegister(std::string& text, int& result)
+void formatDiagnostics(const std::vector<chip8asm::Diagnostic>& diagnostics, const std::string& prefix, std::string& log)
 {
-    text = trim(text);
-    
-    if(text.compare("b") == 0)
-        result = REG_B;
-    else if(text.compare("dt") == 0)
-        result = REG_DT;
-    else if(text.compare("f") == 0)
-        result = REG_F;
-    else if(text.compare("i") == 0)
-        result = REG_I;
-    else if(text.compare("[i]") == 0)
-        result = REG_I_INDIRECT;
-    else if(text.compare("k") == 0)
-        result = REG_K;
-    else if(text.compare("st") == 0)
-        result = REG_ST;
-    else if(text.compare("v0") == 0)
-        result = REG_V0;
-    else if(text.compare("v1") == 0)
-        result = REG_V1;
-    else if(text.compare("v2") == 0)
-        result = REG_V2;
-    else if(text.compare("v3") == 0)
-        result = REG_V3;
-    else if(text.compare("v4") == 0)
-        result = REG_V4;
-    else if(text.compare("v5") == 0)
-        result = REG_V5;
-    else if(text.compare("v6") == 0)
-        result = REG_V6;
-    else if(text.compare("v7") == 0)
-        result = REG_V7;
-    else if(text.compare("v8") == 0)
-        result = REG_V8;
-    else if(text.compare("v9") == 0)
-        result = REG_V9;
-    else if(text.compare("va") == 0)
-        result = REG_VA;
-    else if(text.compare("vb") == 0)
-        result = REG_VB;
-    else if(text.compare("vc") == 0)
-        result = REG_VC;
-    else if(text.compare("vd") == 0)
-        result = REG_VD;
-    else if(text.compare("ve") == 0)
-        result = REG_VE;
-    else if(text.compare("vf") == 0)
-        result = REG_VF;
-    else
-        return false;
+    char line[512];
     
-    return true;
+    for(const chip8asm::Diagnostic& diagnostic : diagnostics)
+    {
+        if(diagnostic.line > 0  &&  diagnostic.column >= 0)
+            snprintf(line, sizeof(line), "%sline %d, col %d:  %s\n", prefix.c_str(), diagnostic.line, diagnostic.column, diagnostic.message.c_str());
+        else if(diagnostic.line > 0)
+            snprintf(line, sizeof(line), "%sline %d:  %s\n", prefix.c_str(), diagnostic.line, diagnostic.message.c_str());
+        else
+            snprintf(line, sizeof(line), "%s%s\n", prefix.c_str(), diagnostic.message.c_str());
+        
+        log += line;
+    }
 }
 
 
@@ -204,819 +176,582 @@ bool parseRegister(std::string& text, int& result)
 //
 //
 
-std::vector<Token> split(const std::string& line)
+std::string outputFilenameFor(const std::string& inputFilename)
 {
-    std::vector<Token> tokens;
-    Token token = { -1, "" };
-    int column = 0;
+    std::string outputFilename(inputFilename);
     
-    while(column < line.size()  &&  line[column] != ';')
+    if(outputFilename.size() >= 2  &&
+        (outputFilename.compare(outputFilename.size() - 2, 2, ".s") == 0  ||
+        outputFilename.compare(outputFilename.size() - 2, 2, ".S") == 0))
     {
-        if(line[column] == ':')
-        {
-            if(token.text.empty())
-            {
-                fprintf(stderr, "%d, %d:  label name must preceed colon\n", g_lineNumber, column);
-                exit(1);
-            }
-            else
-            {
-                token.text += ":";
+        outputFilename.resize(outputFilename.size() - 2);
+    }
+    
+    return outputFilename + ".ch8";
+}
 
-                tokens.push_back(token);
-                
-                token.column = -1;
-                token.text.clear();
-            }
-        }
-        else if(isspace(line[column])  ||  line[column] == ',')
-        {
-            if(!token.text.empty())
-            {
-                tokens.push_back(token);
-                
-                token.column = -1;
-                token.text.clear();
-            }
-        }
-        else
-        {
-            if(token.column == -1)
-                token.column = column;
 
-            token.text += std::tolower(line[column]);
-        }
+//
+//
+//
 
-        ++column;
-    }
+// one input of a run; everything it reports is collected in log so a batch
+// can print it in input order
+struct Job
+{
+    std::string inputFilename;
+    std::string outputFilename;
+    std::string prefix;
+    bool success = false;
+    std::string log;
+    
+    chip8asm::Statistics stats;
+    double readTime = 0;
+    double writeTime = 0;
+    size_t writeCount = 0;
+};
+
+
+//
+//
+//
 
-    if(!token.text.empty())
+void assembleFile(const chip8asm::Assembler& assembler, const std::string& serverSocket, Job& job)
+{
+    // read the input file
+    chip8asm::SourceFile source;
+    Clock::time_point start = Clock::now();
+    
+    bool opened = isStandardStream(job.inputFilename) ? chip8asm::readStandardInput(source) : chip8asm::openSource(job.inputFilename, source);
+    job.readTime = secondsSince(start);
+    
+    if(!opened)
     {
-        tokens.push_back(token);
+        job.log += job.prefix + "error opening input file \"" + job.inputFilename + "\"\n";
+        return;
     }
-
-    return tokens;
+    
+    
+    // assemble it, here or on a server that already has its caches warm
+    chip8asm::Options options = assembler.options();
+    chip8asm::Result result;
+    
+    options.includeDirectory = sourceDirectory(job.inputFilename);
+    
+    if(serverSocket.empty())
+        result = chip8asm::Assembler(options).assemble(source.text());
+    else
+    {
+        chip8asm::ServerConnection connection;
+        
+        if(!connection.connect(serverSocket)  ||  !connection.assemble(options, source.text(), result))
+        {
+            job.log += job.prefix + "error talking to server \"" + serverSocket + "\"\n";
+            return;
+        }
+    }
+    
+    job.stats = result.stats;
+    
+    formatDiagnostics(result.diagnostics, job.prefix, job.log);
+    
+    if(!result.success)
+    {
+        job.log += job.prefix + "error assembling input file\n";
+        return;
+    }
+    
+    
+    // write output file
+    start = Clock::now();
+    bool written = writeImage(job.outputFilename, result.image, job.writeCount);
+    job.writeTime = secondsSince(start);
+    
+    if(!written)
+    {
+        job.log += job.prefix + "error opening or writing output file \"" + job.outputFilename + "\"\n";
+        return;
+    }
+    
+    job.success = true;
 }
 
 
 //
-//
+// one rebuild in watch mode; the assembler keeps the parsed source between
+// calls, so only the lines that changed are parsed again
 //
 
-bool readInput(const std::string& inputFilename)
+void rebuildWatched(chip8asm::IncrementalAssembler& assembler, const std::string& inputFilename, const std::string& outputFilename)
 {
-    // open input file
-    std::ifstream inputFile;
-    inputFile.open(inputFilename);
-
-    if(!inputFile)
+    chip8asm::SourceFile source;
+    
+    if(!chip8asm::openSource(inputFilename, source))
     {
         fprintf(stderr, "error opening input file \"%s\"\n", inputFilename.c_str());
-        return false;
+        return;
     }
     
+    Clock::time_point start = Clock::now();
+    chip8asm::Result result = assembler.update(source.text());
+    double seconds = secondsSince(start);
     
-    // initialize some important variables
-    g_lineNumber = 1;
-    uint16_t offset = 0x0200;  // address where chip-8 files are loaded
-    Statement statement;
+    std::string log;
+    formatDiagnostics(result.diagnostics, "", log);
+    fputs(log.c_str(), stderr);
     
+    if(!result.success)
+    {
+        fputs("error assembling input file\n", stderr);
+        return;
+    }
     
-    // read file line-by-line
-    std::string line;
+    size_t writeCount = 0;
     
-    while(getline(inputFile, line))
+    if(!writeImage(outputFilename, result.image, writeCount))
     {
-        auto tokens = split(line);
+        fprintf(stderr, "error opening or writing output file \"%s\"\n", outputFilename.c_str());
+        return;
+    }
+    
+    fprintf(stderr, "%s:  %zu bytes, %zu of %zu lines parsed in %.3f ms\n",
+        outputFilename.c_str(), result.image.size(), assembler.reparsedLines(), result.stats.lines, seconds * 1000);
+}
 
-        if(tokens.empty())
-        {
-            ++g_lineNumber;
-            continue;
-        }
-        
 
-        // handle optional label
-        if(tokens[0].text[tokens[0].text.size() - 1] == ':')
+//
+// assembles the file, then again every time it is saved; never returns
+//
+
+void watchFile(const chip8asm::Options& options, const std::string& inputFilename, const std::string& outputFilename)
+{
+    chip8asm::IncrementalAssembler assembler(options);
+    
+    rebuildWatched(assembler, inputFilename, outputFilename);
+
+#ifdef __linux__
+    // watch the directory rather than the file, since many editors save by
+    // renaming a new file over the old one
+    size_t slash = inputFilename.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : inputFilename.substr(0, slash + 1);
+    std::string name = inputFilename.substr(slash + 1);
+    
+    int descriptor = inotify_init1(IN_CLOEXEC);
+    
+    if(descriptor != -1  &&  inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) != -1)
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        
+        for(;;)
         {
-            tokens[0].text.pop_back();
-            g_symbolTable[tokens[0].text] = offset;
+            ssize_t size = read(descriptor, buffer, sizeof(buffer));
             
-            if(tokens.size() < 2)
+            if(size < 0  &&  errno == EINTR)
                 continue;
-            else
-                tokens = std::vector<Token>(tokens.begin() + 1, tokens.end());
-        }
-        
-        
-        // handle '.org' directive
-        if(tokens[0].text.compare(".org") == 0)
-        {
-            int origin;
             
-            if(tokens.size() != 2  ||  !parseInteger(tokens[1].text, origin, 0xffff))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to '.org'\n", g_lineNumber);
-                return false;
-            }
-
-            offset = origin;
-        }
-        
-        // handle '.byte' directive
-        else if(tokens[0].text.compare(".byte") == 0)
-        {
-            if(tokens.size() < 2)
-            {
-                fprintf(stderr, "line %d:  missing argument to '.byte'\n", g_lineNumber);
-                return false;
-            }
-
-            for(int index = 1; index < tokens.size(); ++index)
+            if(size <= 0)
+                break;
+            
+            // a save can raise several events at once; rebuild once for all
+            bool changed = false;
+            
+            for(ssize_t position = 0; position < size; )
             {
-                int byte;
-                
-                if(!parseInteger(tokens[index].text, byte, 0xff))
-                {
-                    fprintf(stderr, "line %d, col %d:  invalid argument to '.byte'\n", g_lineNumber, tokens[index].column);
-                    return false;
-                }
-                
+                const struct inotify_event *event = (const struct inotify_event *) (buffer + position);
                 
-                statement.instruction = INST_DEFINEBYTE;
-                statement.offset = offset;
-                statement.size = 1;
-                statement.value = byte;
+                if(event->len  &&  name == event->name)
+                    changed = true;
                 
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
+                position += sizeof(struct inotify_event) + event->len;
             }
+            
+            if(changed)
+                rebuildWatched(assembler, inputFilename, outputFilename);
         }
+    }
+    
+    if(descriptor != -1)
+        close(descriptor);
+#endif
+    
+    // elsewhere, or if inotify is unavailable, poll the modification time
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(inputFilename, error);
+    
+    for(;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        std::filesystem::file_time_type current = std::filesystem::last_write_time(inputFilename, error);
         
-        // handle '.word' directive
-        else if(tokens[0].text.compare(".word") == 0)
+        if(!error  &&  current != modified)
         {
-            if(tokens.size() < 2)
-            {
-                fprintf(stderr, "line %d:  missing argument to '.word'\n", g_lineNumber);
-                return false;
-            }
-
-            for(int index = 1; index < tokens.size(); ++index)
-            {
-                int word;
-                
-                if(!parseInteger(tokens[index].text, word, 0xffff))
-                {
-                    fprintf(stderr, "line %d, col %d:  invalid argument to '.word'\n", g_lineNumber, tokens[index].column);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_DEFINEWORD;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.value = word;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
+            modified = current;
+            rebuildWatched(assembler, inputFilename, outputFilename);
         }
+    }
+}
+
+
+//
+// peak resident set size of the process in bytes, or 0 where unknown
+//
 
-        // handle 'add vx, nn' or 'add vx, vy' or 'add i, vx' instruction
-        else if(tokens[0].text.compare("add") == 0)
+size_t peakResidentSize()
+{
+#ifdef CHIP8ASM_POSIX
+    struct rusage usage;
+    
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+
+//
+//
+//
+
+void appendJsonString(std::string& out, const std::string& text)
+{
+    char escape[8];
+    
+    out += '"';
+    
+    for(char c : text)
+    {
+        if(c == '"'  ||  c == '\\')
         {
-            int reg1, reg2, byte;
-            
-            if(parseRegister(tokens[2].text, reg2))
-            {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  reg2 < REG_V0  ||  reg2 > REG_VF)
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'add'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                if(reg1 == REG_I)
-                {
-                    statement.instruction = INST_ADD_I_VX;
-                    statement.offset = offset;
-                    statement.size = 2;
-                    statement.x = reg2;
-                    
-                    g_statements.push_back(statement);
-                    
-                    offset += statement.size;
-                }
-                else if(reg1 >= REG_V0  &&  reg1 <= REG_VF)
-                {
-                    statement.instruction = INST_ADD_VX_VY;
-                    statement.offset = offset;
-                    statement.size = 2;
-                    statement.x = reg1;
-                    statement.y = reg2;
-                    
-                    g_statements.push_back(statement);
-                    
-                    offset += statement.size;
-                }
-                else
-                {
-                    fprintf(stderr, "line %d:  invalid argument to 'add'\n", g_lineNumber);
-                    return false;
-                }
-            }
-            else
-            {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseInteger(tokens[2].text, byte, 0xff))
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'add'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_ADD_VX_NN;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg1;
-                statement.nn = byte;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
+            out += '\\';
+            out += c;
         }
-
-        // handle 'and vx, vy' instruction
-        else if(tokens[0].text.compare("and") == 0)
+        else if((unsigned char) c < 0x20)
         {
-            int reg1, reg2;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'and'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_AND_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
         }
+        else
+            out += c;
+    }
+    
+    out += '"';
+}
+
+
+//
+// one file's phases and counts, as aligned text or as a json object
+//
 
-        // handle 'call addr' instruction
-        else if(tokens[0].text.compare("call") == 0)
+void formatStats(const Job& job, bool json, std::string& out)
+{
+    const chip8asm::Statistics& stats = job.stats;
+    
+    const char *names[] = { "read", "tokenize", "parse", "define", "resolve", "emit", "write" };
+    double times[] = { job.readTime, stats.tokenizeTime, stats.parseTime, stats.defineTime, stats.resolveTime, stats.emitTime, job.writeTime };
+    char line[256];
+    
+    if(json)
+    {
+        out += "    { \"file\": ";
+        appendJsonString(out, job.inputFilename);
+        
+        snprintf(line, sizeof(line), ", \"success\": %s, \"lines\": %zu, \"tokens\": %zu, \"statements\": %zu, \"symbols\": %zu, \"bytes\": %zu, \"writes\": %zu,\n      \"seconds\": { ",
+            job.success ? "true" : "false", stats.lines, stats.tokens, stats.statements, stats.symbols, stats.bytes, job.writeCount);
+        out += line;
+        
+        for(size_t index = 0; index < sizeof(times) / sizeof(times[0]); ++index)
         {
-            if(tokens.size() != 2)
-            {
-                fprintf(stderr, "line %d:  missing or unexpected argument to 'call'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_CALL_ADDR;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.address = tokens[1].text;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            snprintf(line, sizeof(line), "%s\"%s\": %.9f", index ? ", " : "", names[index], times[index]);
+            out += line;
         }
+        
+        out += " } }";
+        return;
+    }
+    
+    out += job.inputFilename + "\n";
+    
+    for(size_t index = 0; index < sizeof(times) / sizeof(times[0]); ++index)
+    {
+        snprintf(line, sizeof(line), "    %-10s %10.3f ms\n", names[index], times[index] * 1000);
+        out += line;
+    }
+    
+    snprintf(line, sizeof(line), "    %zu lines, %zu tokens, %zu statements, %zu symbols, %zu bytes in %zu write call(s)\n",
+        stats.lines, stats.tokens, stats.statements, stats.symbols, stats.bytes, job.writeCount);
+    out += line;
+}
+
+
+//
+// the screen in half-block characters, two pixel rows to a line of text
+//
 
-        // handle 'cls' instruction
-        else if(tokens[0].text.compare("cls") == 0)
+void drawScreen(const uint64_t *screen, std::string& out)
+{
+    static const char *const blocks[] = { " ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88" };
+    
+    for(int y = 0; y < chip8asm::SCREEN_HEIGHT; y += 2)
+    {
+        for(int x = 0; x < chip8asm::SCREEN_WIDTH; ++x)
         {
-            if(tokens.size() != 1)
-            {
-                fprintf(stderr, "line %d:  unexpected argument to 'cls'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_CLS;
-            statement.offset = offset;
-            statement.size = 2;
+            int top = (screen[y] >> (63 - x)) & 1;
+            int bottom = (screen[y + 1] >> (63 - x)) & 1;
             
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            out += blocks[top | (bottom << 1)];
         }
+        
+        out += '\n';
+    }
+}
 
-        // handle 'drw vx, vy, n' instruction
-        else if(tokens[0].text.compare("drw") == 0)
-        {
-            int reg1, reg2, nibble;
-            
-            if(tokens.size() != 4  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2)  ||  !parseInteger(tokens[3].text, nibble, 0xf))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'drw'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_DRW_VX_VY_N;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            statement.n = nibble;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
 
-        // handle 'jp addr' or 'jp v0, addr' instruction
-        else if(tokens[0].text.compare("jp") == 0)
-        {
-            int reg1;
+#ifdef CHIP8ASM_POSIX
+volatile sig_atomic_t g_interrupted = 0;
 
-            if(parseRegister(tokens[1].text, reg1)  &&  reg1 == REG_V0)
-            {
-                if(tokens.size() != 3)
-                {
-                    fprintf(stderr, "line %d:  missing or unexpected argument to 'jp'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_JP_V0_ADDR;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.address = tokens[1].text;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-            else
-            {
-                if(tokens.size() != 2)
-                {
-                    fprintf(stderr, "line %d:  missing or unexpected argument to 'jp'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_JP_ADDR;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.address = tokens[1].text;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-        }
+void interrupt(int)
+{
+    g_interrupted = 1;
+}
+#endif
 
-        // handle various 'ld' instruction
-        else if(tokens[0].text.compare("ld") == 0)
-        {
-            int reg1, reg2, byte;
 
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1))
-            {
-                fprintf(stderr, "line %d:  missing or unexpected argument to 'ld'\n", g_lineNumber);
-                return false;
-            }
+// the keypad's keys 0 to f on the left of a qwerty keyboard, the way most
+// emulators lay them out; a terminal reports presses but not releases, so
+// a key counts as held for a few frames after each press
+const char g_keypad[] = "x123qweasdzc4rfv";
+constexpr int KEY_HOLD_FRAMES = 10;
 
-            if(reg1 >= REG_V0  &&  reg1 <= REG_VF)
-            {
-                if(!parseRegister(tokens[2].text, reg2))
-                {
-                    if(!parseInteger(tokens[2].text, byte, 0xff))
-                    {
-                        fprintf(stderr, "line %d:  invalid argument to 'ld'\n", g_lineNumber);
-                        return false;
-                    }
-
-
-                    statement.instruction = INST_LD_VX_NN;
-                    statement.offset = offset;
-                    statement.size = 2;
-                    statement.x = reg1;
-                    statement.nn = byte;
-                    
-                    g_statements.push_back(statement);
-                    
-                    offset += statement.size;
-                }
-                else
-                {
-                    switch(reg2)
-                    {
-                        case REG_DT:  statement.instruction = INST_LD_VX_DT;  break;
-                        case REG_I_INDIRECT:  statement.instruction = INST_LD_VX_I;  break;
-                        case REG_K:   statement.instruction = INST_LD_VX_N;  break;
-                        case REG_V0:
-                        case REG_V1:
-                        case REG_V2:
-                        case REG_V3:
-                        case REG_V4:
-                        case REG_V5:
-                        case REG_V6:
-                        case REG_V7:
-                        case REG_V8:
-                        case REG_V9:
-                        case REG_VA:
-                        case REG_VB:
-                        case REG_VC:
-                        case REG_VD:
-                        case REG_VE:
-                        case REG_VF:  statement.instruction = INST_LD_VX_VY;  break;
-                        default:
-                            fprintf(stderr, "line %d:  invalid argument to 'ld'\n", g_lineNumber);
-                            return false;
-                    }
-                    
-                    statement.offset = offset;
-                    statement.size = 2;
-                    statement.x = reg1;
-                    statement.y = reg2;
-                    
-                    g_statements.push_back(statement);
-                    
-                    offset += statement.size;
-                }
-            }
-            else if(reg1 == REG_I)
-            {
-                statement.instruction = INST_LD_I_ADDR;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.address = tokens[2].text;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-            else
-            {
-                if(!parseRegister(tokens[2].text, reg2)  ||  reg2 < REG_V0  ||  reg2 > REG_VF)
-                {
-                    fprintf(stderr, "line %d:  invalid argument to 'ld'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                switch(reg1)
-                {
-                    case REG_B:   statement.instruction = INST_LD_B_VX;   break;
-                    case REG_DT:  statement.instruction = INST_LD_DT_VX;  break;
-                    case REG_F:   statement.instruction = INST_LD_F_VX;   break;
-                    case REG_I_INDIRECT:  statement.instruction = INST_LD_I_VX;  break;
-                    case REG_ST:  statement.instruction = INST_LD_ST_VX;  break;
-                    default:
-                        fprintf(stderr, "line %d:  invalid argument to 'ld'\n", g_lineNumber);
-                        return false;
-                }
-                
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg2;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-        }
 
-        // handle 'or vx, vy' instruction
-        else if(tokens[0].text.compare("or") == 0)
-        {
-            int reg1, reg2;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'or'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_OR_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
+//
+// runs the program at speed instructions a frame, 60 frames a second,
+// drawing the screen in the terminal and reading the keypad from it, until
+// the program halts or fails, cycles instructions have run, or escape or
+// ctrl-c is pressed
+//
 
-        // handle 'ret' instruction
-        else if(tokens[0].text.compare("ret") == 0)
-        {
-            if(tokens.size() != 1)
-            {
-                fprintf(stderr, "line %d:  unexpected argument to 'ret'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_RET;
-            statement.offset = offset;
-            statement.size = 2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
+int runOnTerminal(chip8asm::Interpreter& interpreter, uint64_t cycles, int speed)
+{
+#ifdef CHIP8ASM_POSIX
+    // keys come from the terminal itself, so the source may still be piped in
+    int terminal = open("/dev/tty", O_RDONLY | O_NONBLOCK);
+    struct termios saved;
+    bool raw = terminal != -1  &&  tcgetattr(terminal, &saved) == 0;
+    
+    if(raw)
+    {
+        struct termios settings = saved;
+        settings.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(terminal, TCSANOW, &settings);
+    }
+    
+    signal(SIGINT, interrupt);
+#endif
+    
+    int held[16] = {};
+    int status = chip8asm::RUN_LIMIT;
+    bool quit = false;
+    std::string out = "\x1b[2J";
+    Clock::time_point frame = Clock::now();
+    
+    while(!quit  &&  (!cycles  ||  interpreter.executed() < cycles))
+    {
+        uint16_t keys = 0;
 
-        // handle 'rnd vx, nn' instruction
-        else if(tokens[0].text.compare("rnd") == 0)
+#ifdef CHIP8ASM_POSIX
+        char input[64];
+        ssize_t size = terminal != -1 ? read(terminal, input, sizeof(input)) : 0;
+        
+        for(ssize_t index = 0; index < size; ++index)
         {
-            int reg1, byte;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseInteger(tokens[2].text, byte, 0xff))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'rnd'\n", g_lineNumber);
-                return false;
-            }
+            const char *key = input[index] ? strchr(g_keypad, tolower(input[index])) : nullptr;
             
-            
-            statement.instruction = INST_RND_VX_NN;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.nn = byte;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            if(input[index] == '\x1b')
+                quit = true;
+            else if(key)
+                held[key - g_keypad] = KEY_HOLD_FRAMES;
         }
-
-        // handle 'se vx, nn' or 'se vx, vy' instruction
-        else if(tokens[0].text.compare("se") == 0)
+        
+        quit = quit  ||  g_interrupted;
+#endif
+        
+        for(int key = 0; key < 16; ++key)
         {
-            int reg1, reg2, byte;
-            
-            if(parseRegister(tokens[2].text, reg2))
-            {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1))
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'se'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_SE_VX_VY;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg1;
-                statement.y = reg2;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-            else
+            if(held[key])
             {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseInteger(tokens[2].text, byte, 0xff))
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'se'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_SE_VX_NN;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg1;
-                statement.nn = byte;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
+                --held[key];
+                keys |= 1 << key;
             }
         }
-
-        // handle 'shl vx' instruction
-        else if(tokens[0].text.compare("shl") == 0)
+        
+        interpreter.setKeys(keys);
+        status = interpreter.run(cycles ? std::min<uint64_t>(speed, cycles - interpreter.executed()) : speed);
+        
+        if(interpreter.takeRedraw())
         {
-            int reg1;
-            
-            if(tokens.size() != 2  ||  !parseRegister(tokens[1].text, reg1))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'shl'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SHL_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = 0;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            out += "\x1b[H";
+            drawScreen(interpreter.screen(), out);
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+            out.clear();
         }
+        
+        if(status == chip8asm::RUN_HALTED  ||  status == chip8asm::RUN_ERROR)
+            break;
+        
+        frame += std::chrono::microseconds(1000000 / 60);
+        std::this_thread::sleep_until(frame);
+    }
 
-        // handle 'shr vx' instruction
-        else if(tokens[0].text.compare("shr") == 0)
-        {
-            int reg1;
-            
-            if(tokens.size() != 2  ||  !parseRegister(tokens[1].text, reg1))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'shr'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SHR_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = 0;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
+#ifdef CHIP8ASM_POSIX
+    signal(SIGINT, SIG_DFL);
+    
+    if(raw)
+        tcsetattr(terminal, TCSANOW, &saved);
+    
+    if(terminal != -1)
+        close(terminal);
+#endif
+    
+    return status;
+}
 
-        // handle 'sne vx, nn' or 'sne vx, vy' instruction
-        else if(tokens[0].text.compare("sne") == 0)
-        {
-            int reg1, reg2, byte;
-            
-            if(parseRegister(tokens[2].text, reg2))
-            {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1))
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'sne'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_SNE_VX_VY;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg1;
-                statement.y = reg2;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-            else
-            {
-                if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseInteger(tokens[2].text, byte, 0xff))
-                {
-                    fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'sne'\n", g_lineNumber);
-                    return false;
-                }
-                
-                
-                statement.instruction = INST_SNE_VX_NN;
-                statement.offset = offset;
-                statement.size = 2;
-                statement.x = reg1;
-                statement.nn = byte;
-                
-                g_statements.push_back(statement);
-                
-                offset += statement.size;
-            }
-        }
 
-        // handle 'sknp vx' instruction
-        else if(tokens[0].text.compare("sknp") == 0)
-        {
-            int reg1;
+//
+// a count of instructions, which may be larger than an int
+//
 
-            if(tokens.size() != 2  ||  !parseRegister(tokens[1].text, reg1))
-            {
-                fprintf(stderr, "line %d:  missing or unexpected argument to 'sknp'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SKNP_VX;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
+bool parseCount(const char *text, uint64_t& count)
+{
+    char *end = nullptr;
+    
+    if(*text < '0'  ||  *text > '9')
+        return false;
+    
+    errno = 0;
+    count = strtoull(text, &end, 0);
+    
+    return *end == '\0'  &&  errno == 0;
+}
 
-        // handle 'skp vx' instruction
-        else if(tokens[0].text.compare("skp") == 0)
-        {
-            int reg1;
 
-            if(tokens.size() != 2  ||  !parseRegister(tokens[1].text, reg1))
-            {
-                fprintf(stderr, "line %d:  missing or unexpected argument to 'skp'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SKP_VX;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
-        }
+//
+// chip8asm run: assembles a source and runs the image, in the terminal or
+// headless as fast as the interpreter goes
+//
 
-        // handle 'sub vx, vy' instruction
-        else if(tokens[0].text.compare("sub") == 0)
+int runProgram(int argc, char *argv[])
+{
+    bool headless = false;
+    uint64_t cycles = 0;
+    int speed = 10;
+    int seed = 1;
+    int argument = 2;
+    
+    for(; argument < argc  &&  argv[argument][0] == '-'  &&  argv[argument][1] != '\0'; ++argument)
+    {
+        if(strcmp(argv[argument], "--headless") == 0)
         {
-            int reg1, reg2;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'sub'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SUB_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            headless = true;
         }
-
-        // handle 'subn vx, vy' instruction
-        else if(tokens[0].text.compare("subn") == 0)
+        else if(strcmp(argv[argument], "--cycles") == 0  &&  argument + 1 < argc  &&  parseCount(argv[argument + 1], cycles))
         {
-            int reg1, reg2;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'subn'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_SUBN_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            ++argument;
         }
-
-        // handle 'xor vx, vy' instruction
-        else if(tokens[0].text.compare("xor") == 0)
+        else if(strcmp(argv[argument], "--speed") == 0  &&  argument + 1 < argc  &&  chip8asm::parseInteger(argv[argument + 1], speed, 0xffff)  &&  speed > 0)
         {
-            int reg1, reg2;
-            
-            if(tokens.size() != 3  ||  !parseRegister(tokens[1].text, reg1)  ||  !parseRegister(tokens[2].text, reg2))
-            {
-                fprintf(stderr, "line %d:  missing, unexpected, or invalid argument(s) to 'xor'\n", g_lineNumber);
-                return false;
-            }
-            
-            
-            statement.instruction = INST_XOR_VX_VY;
-            statement.offset = offset;
-            statement.size = 2;
-            statement.x = reg1;
-            statement.y = reg2;
-            
-            g_statements.push_back(statement);
-            
-            offset += statement.size;
+            ++argument;
+        }
+        else if(strcmp(argv[argument], "--seed") == 0  &&  argument + 1 < argc  &&  chip8asm::parseInteger(argv[argument + 1], seed, 0xffff))
+        {
+            ++argument;
         }
-
-        // handle unknown instructions
         else
         {
-            fprintf(stderr, "line %d:  unknown instruction %s\n", g_lineNumber, tokens[0].text.c_str());
-            return false;
+            fprintf(stderr, "unknown or invalid option \"%s\"\n", argv[argument]);
+            return 1;
         }
-
+    }
+    
+    if(argument + 1 != argc)
+    {
+        fprintf(stderr, "\nusage:  chip8asm run [--headless] [--cycles n] [--speed instructions per frame] [--seed n] <filename>|-\n");
+        return 1;
+    }
+    
+    
+    // assemble the source
+    std::string inputFilename = argv[argument];
+    chip8asm::SourceFile source;
+    
+    if(!(isStandardStream(inputFilename) ? chip8asm::readStandardInput(source) : chip8asm::openSource(inputFilename, source)))
+    {
+        fprintf(stderr, "error opening input file \"%s\"\n", inputFilename.c_str());
+        return 1;
+    }
+    
+    chip8asm::Options options;
+    options.includeDirectory = sourceDirectory(inputFilename);
+    
+    chip8asm::Result result = chip8asm::Assembler(options).assemble(source.text());
+    
+    std::string log;
+    formatDiagnostics(result.diagnostics, "", log);
+    fputs(log.c_str(), stderr);
+    
+    if(!result.success)
+    {
+        fputs("error assembling input file\n", stderr);
+        return 1;
+    }
+    
+    chip8asm::Interpreter interpreter(speed, seed);
+    
+    if(!interpreter.load(result.image, result.origin))
+    {
+        fprintf(stderr, "the image does not fit in the %d bytes of memory\n", chip8asm::MACHINE_MEMORY_SIZE);
+        return 1;
+    }
+    
+    
+    // headless, the program runs flat out and the screen it ends on is
+    // printed once
+    Clock::time_point start = Clock::now();
+    int status;
+    
+    if(headless)
+    {
+        status = interpreter.run(cycles ? cycles : UINT64_MAX);
         
-        ++g_lineNumber;
+        std::string out;
+        drawScreen(interpreter.screen(), out);
+        fputs(out.c_str(), stdout);
     }
+    else
+        status = runOnTerminal(interpreter, cycles, speed);
     
+    double seconds = secondsSince(start);
     
-    return true;
+    switch(status)
+    {
+        case chip8asm::RUN_LIMIT:    fprintf(stderr, "stopped at $%03x\n", interpreter.pc());  break;
+        case chip8asm::RUN_HALTED:   fprintf(stderr, "halted at $%03x\n", interpreter.pc());  break;
+        case chip8asm::RUN_WAITING:  fprintf(stderr, "waiting for a key at $%03x\n", interpreter.pc());  break;
+        default:                     fprintf(stderr, "%s\n", interpreter.error().c_str());  break;
+    }
+    
+    fprintf(stderr, "%llu instructions in %.3f s, %.1f million a second\n",
+        (unsigned long long) interpreter.executed(), seconds, seconds > 0 ? interpreter.executed() / seconds / 1e6 : 0);
+    
+    return status == chip8asm::RUN_ERROR ? 1 : 0;
 }
 
 
@@ -1024,265 +759,28 @@ bool readInput(const std::string& inputFilename)
 //
 //
 
-bool writeOutput(const std::string& outputFilename)
+bool readResponseFile(const std::string& filename, std::vector<std::string>& inputFilenames)
 {
-    // open output file
-    std::ofstream outputFile;
-    outputFile.open(outputFilename, std::ios::binary);
-
-    if(!outputFile)
-    {
-        fprintf(stderr, "error opening output file \"%s\"\n", outputFilename.c_str());
-        return false;
-    }
+    chip8asm::SourceFile source;
     
+    if(!chip8asm::openSource(filename, source))
+        return false;
     
-    uint8_t byte;
-    uint16_t word;
-    int address;
-    std::vector<Statement>::iterator statementItor;
-    std::map<std::string, int>::iterator symbolItor;
+    // one filename per line; surrounding whitespace and blank lines are ignored
+    std::string_view text = source.text();
     
-    for(statementItor = g_statements.begin(); statementItor != g_statements.end(); ++statementItor)
+    while(!text.empty())
     {
-        switch(statementItor->instruction)
-        {
-            case INST_DEFINEBYTE:
-                byte = statementItor->value;
-                
-                outputFile.write((char *) &byte, 1);
-                break;
-            
-            case INST_DEFINEWORD:
-                word = statementItor->value;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_CLS:
-                word = 0x00e0;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_RET:
-                word = 0x00ee;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_JP_ADDR:
-                if((symbolItor = g_symbolTable.find(statementItor->address)) != g_symbolTable.end())
-                    word = 0x1000 | symbolItor->second;
-                else if(parseInteger(statementItor->address, address, 0xfff))
-                    word = 0x1000 | address;
-                
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_CALL_ADDR:
-                if((symbolItor = g_symbolTable.find(statementItor->address)) != g_symbolTable.end())
-                    word = 0x2000 | symbolItor->second;
-                else if(parseInteger(statementItor->address, address, 0xfff))
-                    word = 0x2000 | address;
-                
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SE_VX_NN:
-                word = 0x3000 | (statementItor->x << 8) | statementItor->nn;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SNE_VX_NN:
-                word = 0x4000 | (statementItor->x << 8) | statementItor->nn;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SE_VX_VY:
-                word = 0x5000 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_VX_NN:
-                word = 0x6000 | (statementItor->x << 8) | statementItor->nn;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_ADD_VX_NN:
-                word = 0x7000 | (statementItor->x << 8) | statementItor->nn;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_VX_VY:
-                word = 0x8000 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_OR_VX_VY:
-                word = 0x8001 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_AND_VX_VY:
-                word = 0x8002 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_XOR_VX_VY:
-                word = 0x8003 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_ADD_VX_VY:
-                word = 0x8004 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SUB_VX_VY:
-                word = 0x8005 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SHR_VX_VY:
-                word = 0x8006 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SUBN_VX_VY:
-                word = 0x8007 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SHL_VX_VY:
-                word = 0x800e | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SNE_VX_VY:
-                word = 0x9000 | (statementItor->x << 8) | (statementItor->y << 4);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_I_ADDR:
-                if((symbolItor = g_symbolTable.find(statementItor->address)) != g_symbolTable.end())
-                    word = 0xa000 | symbolItor->second;
-                else if(parseInteger(statementItor->address, address, 0xfff))
-                    word = 0xa000 | address;
-                
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_JP_V0_ADDR:
-                if((symbolItor = g_symbolTable.find(statementItor->address)) != g_symbolTable.end())
-                    word = 0xb000 | symbolItor->second;
-                else if(parseInteger(statementItor->address, address, 0xfff))
-                    word = 0xb000 | address;
-                
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_RND_VX_NN:
-                word = 0xc000 | (statementItor->x << 8) | statementItor->nn;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_DRW_VX_VY_N:
-                word = 0xd000 | (statementItor->x << 8) | (statementItor->y << 4) | statementItor->n;
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SKP_VX:
-                word = 0xe09e | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_SKNP_VX:
-                word = 0xe0a1 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_VX_DT:
-                word = 0xf007 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_VX_N:
-                word = 0xf00a | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_DT_VX:
-                word = 0xf015 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_ST_VX:
-                word = 0xf018 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_ADD_I_VX:
-                word = 0xf01e | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_F_VX:
-                word = 0xf029 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_B_VX:
-                word = 0xf033 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_I_VX:
-                word = 0xf055 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-            
-            case INST_LD_VX_I:
-                word = 0xf065 | (statementItor->x << 8);
-                outputFile.write((char *) &word + 1, 1);
-                outputFile.write((char *) &word, 1);
-                break;
-
-            default:
-                fprintf(stderr, "unexpected instruction %d\n", statementItor->instruction);
-                return false;
-        }
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        
+        size_t first = line.find_first_not_of(" \f\r\t\v");
+        size_t last = line.find_last_not_of(" \f\r\t\v");
+        
+        if(first != std::string_view::npos)
+            inputFilenames.emplace_back(line.substr(first, last - first + 1));
     }
     
     return true;
@@ -1295,43 +793,207 @@ bool writeOutput(const std::string& outputFilename)
 
 int main(int argc,char *argv[])
 {
-    // ensure we got a filename
-    if(argc != 2)
+    if(argc > 1  &&  strcmp(argv[1], "run") == 0)
+        return runProgram(argc, argv);
+    
+    // parse options, then gather the input filenames
+    int fill = 0;
+    int jobs = 0;
+    bool stats = false;
+    bool statsJson = false;
+    bool watch = false;
+    bool singlePass = false;
+    std::string outputFilename;
+    std::string listenSocket;
+    std::string serverSocket;
+    int argument = 1;
+    
+    // a lone "-" is standard input, so it ends the options like a filename
+    for(; argument < argc  &&  argv[argument][0] == '-'  &&  argv[argument][1] != '\0'; ++argument)
     {
-        fprintf(stderr, "\nusage:  chip8asm <filename>\n");
+        if(strcmp(argv[argument], "--fill") == 0  &&  argument + 1 < argc  &&  chip8asm::parseInteger(argv[argument + 1], fill, 0xff))
+        {
+            ++argument;
+        }
+        else if(strcmp(argv[argument], "-j") == 0  &&  argument + 1 < argc  &&  chip8asm::parseInteger(argv[argument + 1], jobs, 0xffff))
+        {
+            ++argument;
+        }
+        else if(strcmp(argv[argument], "--stats") == 0  ||  strcmp(argv[argument], "--stats=text") == 0)
+        {
+            stats = true;
+        }
+        else if(strcmp(argv[argument], "--stats=json") == 0)
+        {
+            stats = statsJson = true;
+        }
+        else if(strcmp(argv[argument], "-o") == 0  &&  argument + 1 < argc)
+        {
+            outputFilename = argv[++argument];
+        }
+        else if(strcmp(argv[argument], "--single-pass") == 0)
+        {
+            singlePass = true;
+        }
+        else if(strcmp(argv[argument], "--watch") == 0)
+        {
+            watch = true;
+        }
+        else if(strcmp(argv[argument], "--serve") == 0  &&  argument + 1 < argc)
+        {
+            listenSocket = argv[++argument];
+        }
+        else if(strcmp(argv[argument], "--connect") == 0  &&  argument + 1 < argc)
+        {
+            serverSocket = argv[++argument];
+        }
+        else
+        {
+            fprintf(stderr, "unknown or invalid option \"%s\"\n", argv[argument]);
+            return 1;
+        }
+    }
+    
+    if(!listenSocket.empty())
+    {
+        if(argument < argc)
+        {
+            fprintf(stderr, "--serve takes no input files\n");
+            return 1;
+        }
+        
+        chip8asm::serve(listenSocket);
+        fprintf(stderr, "error listening on socket \"%s\"\n", listenSocket.c_str());
         return 1;
     }
-
-    std::string inputFilename(argv[1]);
     
+    std::vector<std::string> inputFilenames;
     
-    // figure out the output filename
-    std::string outputFilename(argv[1]);
-
-    if(outputFilename.compare(outputFilename.size() - 2, 2, ".s") == 0  ||
-        outputFilename.compare(outputFilename.size() - 2, 2, ".S") == 0)
+    for(; argument < argc; ++argument)
     {
-        outputFilename.resize(outputFilename.size() - 2);
+        if(argv[argument][0] != '@')
+            inputFilenames.emplace_back(argv[argument]);
+        else if(!readResponseFile(argv[argument] + 1, inputFilenames))
+        {
+            fprintf(stderr, "error opening response file \"%s\"\n", argv[argument] + 1);
+            return 1;
+        }
     }
-
-    outputFilename += ".ch8";
-
     
-    // parse statements from input file
-    if(!readInput(inputFilename))
+    if(inputFilenames.empty()  ||  ((watch  ||  !outputFilename.empty())  &&  inputFilenames.size() != 1))
     {
-        fprintf(stderr, "error reading input file\n");
+        fprintf(stderr, "\nusage:  chip8asm [--fill byte] [-j threads] [--single-pass] [--stats[=json]] [--connect socket] <filename>... | @<response file>\n");
+        fprintf(stderr, "        chip8asm [--fill byte] [-j threads] [--single-pass] [--stats[=json]] [--connect socket] [-o <output>|-] <filename>|-\n");
+        fprintf(stderr, "        chip8asm [--fill byte] [-o <output>] --watch <filename>\n");
+        fprintf(stderr, "        chip8asm --serve <socket>\n");
+        fprintf(stderr, "        chip8asm run [--headless] [--cycles n] [--speed instructions per frame] [--seed n] <filename>|-\n");
         return 1;
     }
-
-
-    // write output file
-    if(!writeOutput(outputFilename))
+    
+    
+    // a lone file may split its parse across the threads; a batch already
+    // keeps them busy with one file each
+    chip8asm::Options options;
+    options.fill = fill;
+    options.threads = inputFilenames.size() == 1 ? jobs : 1;
+    options.profile = stats;
+    options.singlePass = singlePass;
+    
+    // standard input is read once, and with nowhere to derive a name from its
+    // image goes to standard output unless -o says otherwise
+    if(std::count_if(inputFilenames.begin(), inputFilenames.end(), isStandardStream) > 1)
     {
-        fprintf(stderr, "error writing output file\n");
+        fprintf(stderr, "standard input can be read only once\n");
         return 1;
     }
-
-
-    return 0;
+    
+    if(watch  &&  (isStandardStream(inputFilenames[0])  ||  isStandardStream(outputFilename)))
+    {
+        fprintf(stderr, "--watch needs a file to watch and a file to write\n");
+        return 1;
+    }
+    
+    if(outputFilename.empty()  &&  isStandardStream(inputFilenames[0])  &&  inputFilenames.size() == 1)
+        outputFilename = "-";
+    
+    if(watch)
+    {
+        options.includeDirectory = sourceDirectory(inputFilenames[0]);
+        watchFile(options, inputFilenames[0], outputFilename.empty() ? outputFilenameFor(inputFilenames[0]) : outputFilename);
+        return 0;
+    }
+    
+    chip8asm::Assembler assembler(options);
+    std::vector<Job> batch(inputFilenames.size());
+    
+    size_t allocationCount = g_allocationCount;
+    
+    if(batch.size() == 1)
+    {
+        batch[0].inputFilename = inputFilenames[0];
+        batch[0].outputFilename = outputFilename.empty() ? outputFilenameFor(inputFilenames[0]) : outputFilename;
+        assembleFile(assembler, serverSocket, batch[0]);
+    }
+    else
+    {
+        // each file gets its own context inside assemble(), so the jobs share
+        // nothing but the read-only assembler
+        chip8asm::ThreadPool pool(std::min<int>(jobs > 0 ? jobs : std::thread::hardware_concurrency(), batch.size()));
+        
+        for(size_t index = 0; index < batch.size(); ++index)
+        {
+            Job& job = batch[index];
+            
+            job.inputFilename = inputFilenames[index];
+            job.outputFilename = isStandardStream(job.inputFilename) ? "-" : outputFilenameFor(job.inputFilename);
+            job.prefix = job.inputFilename + ": ";
+            
+            pool.submit([&assembler, &serverSocket, &job] { assembleFile(assembler, serverSocket, job); });
+        }
+        
+        pool.wait();
+    }
+    
+    allocationCount = g_allocationCount - allocationCount;
+    
+    
+    // report in input order, whichever order the jobs finished in
+    int failures = 0;
+    
+    for(const Job& job : batch)
+    {
+        fputs(job.log.c_str(), stderr);
+        
+        if(!job.success)
+            ++failures;
+    }
+    
+    
+    // statistics go to stdout, apart from the diagnostics, for dashboards,
+    // unless the image itself is going there
+    if(stats)
+    {
+        std::string out = statsJson ? "{\n  \"files\": [\n" : "";
+        
+        for(size_t index = 0; index < batch.size(); ++index)
+        {
+            formatStats(batch[index], statsJson, out);
+            
+            if(statsJson)
+                out += index + 1 < batch.size() ? ",\n" : "\n";
+        }
+        
+        char line[256];
+        
+        if(statsJson)
+            snprintf(line, sizeof(line), "  ],\n  \"allocations\": %zu,\n  \"peakRss\": %zu\n}\n", allocationCount, peakResidentSize());
+        else
+            snprintf(line, sizeof(line), "%zu heap allocations, peak rss %.1f MiB\n", allocationCount, peakResidentSize() / (1024.0 * 1024.0));
+        
+        out += line;
+        bool imageOnStdout = std::any_of(batch.begin(), batch.end(), [](const Job& job) { return isStandardStream(job.outputFilename); });
+        fputs(out.c_str(), imageOnStdout ? stderr : stdout);
+    }
+    
+    return failures ? 1 : 0;
 }
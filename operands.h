@@ -0,0 +1,191 @@
+#ifndef CHIP8ASM_OPERANDS_H
+#define CHIP8ASM_OPERANDS_H
+
+#include <cstdint>
+#include <string_view>
+
+#include "expression.h"
+#include "instructions.h"
+#include "tokenizer.h"
+
+
+namespace chip8asm
+{
+
+
+// operand parsing shared by the runtime assembler, over its Context, and the
+// compile-time one in compiletime.h, over its Assembly, so the two cannot
+// drift apart. each state type supplies, found by argument dependent lookup:
+//
+//   uint32_t referenceLabel(State&, std::string_view lower)
+//       the id of a name used in an operand, noting the first line to use it
+//   ExpressionResult foldTerms(const State&, const ExpressionTerm *, int)
+//       the value of terms naming only literals and constants, or pending
+//   uint32_t storeExpression(State&, const ExpressionTerm *, int)
+//       keeps terms for resolution and returns the operand referring to them
+//
+// and a scratchTerms array of MAX_EXPRESSION_TERMS to parse into, so an
+// operand neither clears nor leaves uninitialized a buffer of its own
+
+
+//
+// an expression's terms, with the names in it taken as references
+//
+
+template<typename State>
+constexpr bool parseTerms(State& state, const Token& token, ExpressionTerm *terms, int& count)
+{
+    return parseExpression(token.lower, terms, count, [&state](std::string_view name)
+    {
+        return referenceLabel(state, name);
+    });
+}
+
+
+//
+// an immediate or data value: a literal, or an expression that is folded
+// here when it can be and resolved with the labels when it cannot
+//
+
+template<typename State>
+constexpr bool parseValue(State& state, const Token& token, uint32_t mask, uint32_t& operand)
+{
+    if(token.kind == TOKEN_INTEGER)
+    {
+        operand = token.value;
+        return (uint32_t) token.value <= mask;
+    }
+    
+    if(token.kind != TOKEN_SYMBOL  &&  token.kind != TOKEN_EXPRESSION)
+        return false;
+    
+    ExpressionTerm *terms = state.scratchTerms;
+    int count = 0;
+    
+    if(!parseTerms(state, token, terms, count))
+        return false;
+    
+    ExpressionResult result = foldTerms(state, terms, count);
+    
+    // one that fails to evaluate is kept too, and says why when it resolves
+    if(result.status != EXPRESSION_VALUE)
+    {
+        operand = storeExpression(state, terms, count);
+        return true;
+    }
+    
+    operand = result.value & mask;
+    return operandFits(result.value, mask);
+}
+
+
+//
+// a count or address a directive needs while parsing: a literal, or an
+// expression over literals and constants defined before it
+//
+
+template<typename State>
+constexpr bool parseConstant(State& state, const Token& token, int maxValue, int& value)
+{
+    if(token.kind == TOKEN_INTEGER)
+    {
+        value = token.value;
+        return value <= maxValue;
+    }
+    
+    ExpressionTerm *terms = state.scratchTerms;
+    int count = 0;
+    
+    if(token.kind != TOKEN_EXPRESSION  &&  token.kind != TOKEN_SYMBOL)
+        return false;
+    
+    if(!parseTerms(state, token, terms, count))
+        return false;
+    
+    ExpressionResult result = foldTerms(state, terms, count);
+    
+    value = result.value;
+    return result.status == EXPRESSION_VALUE  &&  value >= 0  &&  value <= maxValue;
+}
+
+
+//
+//
+//
+
+template<typename State>
+constexpr bool parseOperand(State& state, int operand, const InstructionEncoding& encoding, const Token& token, Statement& statement)
+{
+    switch(operand)
+    {
+        case OPERAND_VX:
+            if(token.kind != TOKEN_V_REGISTER)
+                return false;
+            
+            statement.x = token.value;
+            return true;
+        
+        case OPERAND_VY:
+            if(token.kind != TOKEN_V_REGISTER)
+                return false;
+            
+            statement.y = token.value;
+            return true;
+        
+        // an immediate may be as large as its field in the encoding
+        case OPERAND_N:
+        case OPERAND_NN:
+            return parseValue(state, token, encoding.operandMask, statement.operand);
+        
+        case OPERAND_ADDR:
+            // a lone label is common enough to skip the expression machinery
+            if(token.kind != TOKEN_SYMBOL)
+                return parseValue(state, token, encoding.operandMask, statement.operand);
+            
+            statement.operand = STATEMENT_SYMBOL | referenceLabel(state, token.lower);
+            return true;
+        
+        // everything else names one specific register
+        default:
+            return token.isRegister()  &&  token.value == operand - OPERAND_REGISTER;
+    }
+}
+
+
+//
+// tries formCount forms of one mnemonic from firstForm, in table order,
+// until the operands fit; statement then holds the instruction and operands
+//
+
+template<typename State>
+constexpr bool matchForm(State& state, int firstForm, int formCount, const Token *operands, int operandCount, Statement& statement)
+{
+    for(int index = firstForm; index < firstForm + formCount; ++index)
+    {
+        const InstructionForm& form = g_instructionForms[index];
+        const InstructionEncoding& encoding = g_instructionEncodings.encodings[form.instruction];
+        
+        if(operandCount != form.operandCount())
+            continue;
+        
+        bool matched = true;
+        statement = {};
+        
+        for(int operand = 0; matched  &&  operand < operandCount; ++operand)
+            matched = parseOperand(state, form.operands[operand], encoding, operands[operand], statement);
+        
+        if(matched)
+        {
+            statement.instruction = form.instruction;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,289 @@
+#include "context.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "threadpool.h"
+
+
+namespace chip8asm
+{
+
+
+// sources smaller than two of these are parsed on the calling thread, since
+// starting workers would cost more than the parse itself
+constexpr size_t PARALLEL_CHUNK_SIZE = 128 * 1024;
+
+
+// a run of whole lines parsed on its own; until its first .org a chunk does
+// not know where it starts, so it counts addresses from zero
+struct Chunk
+{
+    std::string_view text;
+    Context context;
+    
+    int base = 0;                    // absolute address of the chunk's first byte
+    int firstLine = 0;               // source line number of the chunk's first line
+    size_t firstStatement = 0;       // index of the chunk's first merged statement
+    size_t firstBlock = 0;           // index of the chunk's first merged data block
+    size_t firstExpression = 0;      // index of the chunk's first merged expression
+    std::vector<uint32_t> symbolMap; // chunk symbol id to merged symbol id
+};
+
+
+//
+// prefix sum over the chunks: each one starts where the one before it
+// ended, unless it moved the offset itself with .org; false, leaving the
+// context as it was, if a chunk would then run past the end of memory
+//
+
+static bool placeChunks(Context& context, std::vector<Chunk>& chunks)
+{
+    int offset = context.offset;
+    int lineNumber = 1;
+    size_t statementCount = context.statements.size();
+    
+    for(Chunk& chunk : chunks)
+    {
+        chunk.base = offset;
+        chunk.firstLine = lineNumber;
+        chunk.firstStatement = statementCount;
+        
+        if(offset + (chunk.context.relative ? chunk.context.offset : chunk.context.relativeEnd) > 0x10000)
+            return false;
+        
+        offset = chunk.context.relative ? offset + chunk.context.offset : chunk.context.offset;
+        lineNumber += chunk.context.lineNumber - 1;
+        statementCount += chunk.context.statements.size();
+    }
+    
+    context.offset = offset;
+    context.lineNumber = lineNumber;
+    return true;
+}
+
+
+//
+// false, having merged only some of the labels, if a name is defined in
+// more than one chunk, which only a serial parse can pin on a line
+//
+
+static bool mergeChunks(Context& context, std::vector<Chunk>& chunks, ThreadPool& pool)
+{
+    // merge the label tables in source order, so the first reference keeps
+    // the earliest line, as in a serial parse
+    for(Chunk& chunk : chunks)
+    {
+        const SymbolTable& symbols = chunk.context.symbols;
+        chunk.symbolMap.assign(symbols.symbols.size(), SYMBOL_NONE);
+        
+        for(uint32_t id = 1; id < symbols.symbols.size(); ++id)
+        {
+            uint32_t merged = context.symbols.intern(symbols.name(id));
+            const Symbol& symbol = symbols.symbols[id];
+            Symbol& target = context.symbols.symbols[merged];
+            
+            chunk.symbolMap[id] = merged;
+            
+            if(symbol.value >= 0)
+            {
+                if(target.value >= 0)
+                    return false;
+                
+                target.constant = symbol.constant;
+                
+                if(symbol.value & SYMBOL_RELATIVE)
+                    target.value = chunk.base + (symbol.value & ~SYMBOL_RELATIVE);
+                else
+                    target.value = symbol.value;
+            }
+            
+            if(target.line == 0  &&  symbol.line != 0)
+                target.line = chunk.firstLine + symbol.line - 1;
+        }
+    }
+    
+    
+    // data blocks and expressions move over before the chunks' arenas go;
+    // bytes gathered in a chunk's arena are copied, mapped files just change
+    // hands, and the names in expressions are renumbered
+    for(Chunk& chunk : chunks)
+    {
+        uint32_t firstTerm = context.terms.size();
+        
+        chunk.firstExpression = context.expressions.size();
+        
+        for(Expression expression : chunk.context.expressions)
+        {
+            expression.firstTerm += firstTerm;
+            expression.line += chunk.firstLine - 1;
+            context.expressions.push_back(expression);
+        }
+        
+        for(ExpressionTerm term : chunk.context.terms)
+        {
+            if(term.op == EXPRESSION_SYMBOL)
+                term.value = chunk.symbolMap[term.value];
+            
+            context.terms.push_back(term);
+        }
+        
+        for(Constant constant : chunk.context.constants)
+            context.constants.push_back({ chunk.symbolMap[constant.symbol], (uint32_t) (constant.expression + chunk.firstExpression) });
+        
+        
+        chunk.firstBlock = context.blocks.size();
+        
+        for(DataBlock block : chunk.context.blocks)
+        {
+            if(block.bytes  &&  !block.mapped)
+            {
+                uint8_t *bytes = (uint8_t *) context.arena.allocate(block.size, 1);
+                
+                memcpy(bytes, block.bytes, block.size);
+                block.bytes = bytes;
+            }
+            
+            context.blocks.push_back(block);
+        }
+        
+        for(std::unique_ptr<SourceFile>& binary : chunk.context.binaries)
+            context.binaries.push_back(std::move(binary));
+    }
+    
+    
+    // rebase and renumber each chunk's statements into place
+    size_t statementCount = chunks.back().firstStatement + chunks.back().context.statements.size();
+    
+    context.statements.resize(statementCount);
+    context.statementLines.resize(statementCount);
+    
+    for(Chunk& chunk : chunks)
+    {
+        pool.submit([&context, &chunk]
+        {
+            const ArenaVector<Statement>& statements = chunk.context.statements;
+            size_t relativeCount = chunk.context.relative ? statements.size() : chunk.context.firstAbsolute;
+            Statement *target = context.statements.data() + chunk.firstStatement;
+            int *targetLines = context.statementLines.data() + chunk.firstStatement;
+            
+            for(size_t index = 0; index < statements.size(); ++index)
+            {
+                Statement statement = statements[index];
+                
+                if(index < relativeCount)
+                    statement.offset += chunk.base;
+                
+                if(statement.operand & STATEMENT_SYMBOL)
+                    statement.operand = STATEMENT_SYMBOL | chunk.symbolMap[statement.operand & ~STATEMENT_SYMBOL];
+                else if(statement.operand & STATEMENT_EXPRESSION)
+                    statement.operand += chunk.firstExpression;
+                else if(statement.instruction == INST_DATABLOCK)
+                    statement.operand += chunk.firstBlock;
+                
+                target[index] = statement;
+                targetLines[index] = chunk.context.statementLines[index] + chunk.firstLine - 1;
+            }
+        });
+    }
+    
+    pool.wait();
+    return true;
+}
+
+
+//
+//
+//
+
+bool parseSourceParallel(Context& context, std::string_view source, int threads)
+{
+    if(threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    
+    size_t chunkCount = std::min<size_t>(threads, source.size() / PARALLEL_CHUNK_SIZE);
+    
+    if(chunkCount < 2)
+        return parseSource(context, source);
+    
+    
+    // cut the source into roughly even runs of whole lines
+    std::vector<Chunk> chunks(chunkCount);
+    size_t start = 0;
+    
+    for(size_t index = 0; index < chunkCount; ++index)
+    {
+        size_t end = source.size();
+        
+        if(index + 1 < chunkCount)
+        {
+            end = source.find('\n', std::max(start, source.size() * (index + 1) / chunkCount));
+            end = end == std::string_view::npos ? source.size() : end + 1;
+        }
+        
+        chunks[index].text = source.substr(start, end - start);
+        start = end;
+    }
+    
+    
+    ThreadPool pool((int) chunkCount);
+    
+    for(Chunk& chunk : chunks)
+    {
+        chunk.context.options = context.options;
+        chunk.context.offset = 0;
+        chunk.context.relative = true;
+        
+        pool.submit([&chunk]
+        {
+            parseSource(chunk.context, chunk.text);
+        });
+    }
+    
+    pool.wait();
+    
+    
+    // a chunk may fail for want of something an earlier chunk defines, such
+    // as a constant, so on any error the source is parsed again serially,
+    // which reports exactly what it always would
+    for(const Chunk& chunk : chunks)
+    {
+        if(!chunk.context.diagnostics.empty())
+            return parseSource(context, source);
+    }
+    
+    // so too when the chunks, laid end to end, run past the end of memory,
+    // which only a serial parse can pin on a line
+    int origin = context.offset;
+    
+    if(!placeChunks(context, chunks))
+        return parseSource(context, source);
+    
+    Clock::time_point mergeStart = Clock::now();
+    
+    // and when one chunk defines a name another already has; the context
+    // came in fresh, so dropping the labels merged so far leaves it so again
+    if(!mergeChunks(context, chunks, pool))
+    {
+        context.symbols = SymbolTable(&context.arena);
+        context.offset = origin;
+        return parseSource(context, source);
+    }
+    
+    for(const Chunk& chunk : chunks)
+    {
+        context.stats.tokens += chunk.context.stats.tokens;
+        context.stats.tokenizeTime += chunk.context.stats.tokenizeTime;
+        context.stats.parseTime += chunk.context.stats.parseTime;
+        context.stats.defineTime += chunk.context.stats.defineTime;
+    }
+    
+    if(context.options.profile)
+        context.stats.parseTime += secondsSince(mergeStart);
+    
+    return true;
+}
+
+
+}  // namespace chip8asm
@@ -0,0 +1,202 @@
+#include "scanner.h"
+
+#ifdef CHIP8ASM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+namespace chip8asm
+{
+
+
+//
+// matches isspace() in the "C" locale, plus the operand separator
+//
+
+static void classifyScalar(const char *data, ScanMasks& masks)
+{
+    masks = { 0, 0, 0 };
+    
+    for(size_t index = 0; index < SCAN_BLOCK_SIZE; ++index)
+    {
+        unsigned char c = data[index];
+        uint64_t bit = (uint64_t) 1 << index;
+        
+        if(c == ' '  ||  c == ','  ||  (c >= '\t'  &&  c <= '\r'))
+            masks.delimiters |= bit;
+        else if(c == ':')
+            masks.colons |= bit;
+        else if(c == ';')
+            masks.semicolons |= bit;
+    }
+}
+
+
+//
+//
+//
+
+static void lowerScalar(const char *source, char *target, size_t size)
+{
+    for(size_t index = 0; index < size; ++index)
+    {
+        char c = source[index];
+        
+        target[index] = (c >= 'A'  &&  c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+}
+
+
+const ScanKernels g_scalarKernels = { "scalar", classifyScalar, lowerScalar };
+
+
+#ifdef CHIP8ASM_X86_SIMD
+
+
+//
+// sse2 is part of x86-64, so this needs no cpu check
+//
+
+static void classifySse2(const char *data, ScanMasks& masks)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i controlRange = _mm_set1_epi8('\r' - '\t');
+    
+    masks = { 0, 0, 0 };
+    
+    for(size_t index = 0; index < SCAN_BLOCK_SIZE; index += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (data + index));
+        
+        // '\t' through '\r' is one unsigned range: min(c - '\t', 4) == c - '\t'
+        __m128i control = _mm_sub_epi8(bytes, tab);
+        control = _mm_cmpeq_epi8(_mm_min_epu8(control, controlRange), control);
+        
+        __m128i delimiters = _mm_or_si128(control, _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, comma)));
+        
+        masks.delimiters |= (uint64_t) (uint16_t) _mm_movemask_epi8(delimiters) << index;
+        masks.colons |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, colon)) << index;
+        masks.semicolons |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, semicolon)) << index;
+    }
+}
+
+
+//
+//
+//
+
+static void lowerSse2(const char *source, char *target, size_t size)
+{
+    const __m128i upperA = _mm_set1_epi8('A');
+    const __m128i upperRange = _mm_set1_epi8('Z' - 'A');
+    const __m128i caseBit = _mm_set1_epi8('a' - 'A');
+    size_t index = 0;
+    
+    for(; index + 16 <= size; index += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (source + index));
+        __m128i letter = _mm_sub_epi8(bytes, upperA);
+        
+        letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, upperRange), letter);
+        _mm_storeu_si128((__m128i *) (target + index), _mm_or_si128(bytes, _mm_and_si128(letter, caseBit)));
+    }
+    
+    lowerScalar(source + index, target + index, size - index);
+}
+
+
+const ScanKernels g_sse2Kernels = { "sse2", classifySse2, lowerSse2 };
+
+
+//
+//
+//
+
+__attribute__((target("avx2")))
+static void classifyAvx2(const char *data, ScanMasks& masks)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i semicolon = _mm256_set1_epi8(';');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i controlRange = _mm256_set1_epi8('\r' - '\t');
+    
+    masks = { 0, 0, 0 };
+    
+    for(size_t index = 0; index < SCAN_BLOCK_SIZE; index += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (data + index));
+        
+        __m256i control = _mm256_sub_epi8(bytes, tab);
+        control = _mm256_cmpeq_epi8(_mm256_min_epu8(control, controlRange), control);
+        
+        __m256i delimiters = _mm256_or_si256(control, _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, comma)));
+        
+        masks.delimiters |= (uint64_t) (uint32_t) _mm256_movemask_epi8(delimiters) << index;
+        masks.colons |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, colon)) << index;
+        masks.semicolons |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, semicolon)) << index;
+    }
+}
+
+
+//
+//
+//
+
+__attribute__((target("avx2")))
+static void lowerAvx2(const char *source, char *target, size_t size)
+{
+    const __m256i upperA = _mm256_set1_epi8('A');
+    const __m256i upperRange = _mm256_set1_epi8('Z' - 'A');
+    const __m256i caseBit = _mm256_set1_epi8('a' - 'A');
+    size_t index = 0;
+    
+    for(; index + 32 <= size; index += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (source + index));
+        __m256i letter = _mm256_sub_epi8(bytes, upperA);
+        
+        letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, upperRange), letter);
+        _mm256_storeu_si256((__m256i *) (target + index), _mm256_or_si256(bytes, _mm256_and_si256(letter, caseBit)));
+    }
+    
+    lowerSse2(source + index, target + index, size - index);
+}
+
+
+const ScanKernels g_avx2Kernels = { "avx2", classifyAvx2, lowerAvx2 };
+
+
+#endif
+
+
+//
+//
+//
+
+const ScanKernels& scanKernels()
+{
+    static const ScanKernels& kernels = []() -> const ScanKernels&
+    {
+#ifdef CHIP8ASM_X86_SIMD
+        __builtin_cpu_init();
+        
+        if(__builtin_cpu_supports("avx2"))
+            return g_avx2Kernels;
+        
+        return g_sse2Kernels;
+#else
+        return g_scalarKernels;
+#endif
+    }();
+    
+    return kernels;
+}
+
+
+}  // namespace chip8asm
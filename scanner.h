@@ -0,0 +1,74 @@
+#ifndef CHIP8ASM_SCANNER_H
+#define CHIP8ASM_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)  &&  defined(__x86_64__)
+#define CHIP8ASM_X86_SIMD
+#endif
+
+
+namespace chip8asm
+{
+
+
+// classes of a block of SCAN_BLOCK_SIZE source bytes, bit n for byte n
+inline constexpr size_t SCAN_BLOCK_SIZE = 64;
+
+struct ScanMasks
+{
+    uint64_t delimiters;     // whitespace and commas
+    uint64_t colons;
+    uint64_t semicolons;
+};
+
+
+// classify reads exactly SCAN_BLOCK_SIZE bytes; lower may run in place
+struct ScanKernels
+{
+    const char *name;
+    void (*classify)(const char *data, ScanMasks& masks);
+    void (*lower)(const char *source, char *target, size_t size);
+};
+
+
+extern const ScanKernels g_scalarKernels;
+#ifdef CHIP8ASM_X86_SIMD
+extern const ScanKernels g_sse2Kernels;
+extern const ScanKernels g_avx2Kernels;
+#endif
+
+
+// index of the lowest set bit; bits must not be zero
+inline int countTrailingZeros(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#elif defined(_MSC_VER)  &&  defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int) index;
+#else
+    int count = 0;
+    
+    for(; !(bits & 1); bits >>= 1)
+        ++count;
+    
+    return count;
+#endif
+}
+
+
+// the widest kernels the cpu supports, chosen on first use
+const ScanKernels& scanKernels();
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,652 @@
+#include "server.h"
+
+#include <cstring>
+#include <filesystem>
+
+#include "source.h"
+
+#ifdef CHIP8ASM_POSIX
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+namespace chip8asm
+{
+
+
+#ifdef CHIP8ASM_POSIX
+
+
+// anything longer is not a message from a client
+constexpr uint32_t SERVER_MAXIMUM_MESSAGE = 256 * 1024 * 1024;
+
+
+//
+// little endian fields of a message
+//
+
+static void putInteger(std::string& message, uint64_t value, int size)
+{
+    for(int index = 0; index < size; ++index)
+        message += (char) (value >> (index * 8));
+}
+
+
+//
+//
+//
+
+static bool getInteger(std::string_view& message, uint64_t& value, int size)
+{
+    if(message.size() < (size_t) size)
+        return false;
+    
+    value = 0;
+    
+    for(int index = 0; index < size; ++index)
+        value |= (uint64_t) (uint8_t) message[index] << (index * 8);
+    
+    message.remove_prefix(size);
+    return true;
+}
+
+
+//
+//
+//
+
+static void putDouble(std::string& message, double value)
+{
+    uint64_t bits;
+    
+    memcpy(&bits, &value, sizeof(bits));
+    putInteger(message, bits, 8);
+}
+
+
+//
+//
+//
+
+static bool getDouble(std::string_view& message, double& value)
+{
+    uint64_t bits;
+    
+    if(!getInteger(message, bits, 8))
+        return false;
+    
+    memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+
+//
+//
+//
+
+static void encodeResult(const Result& result, std::string& message)
+{
+    const Statistics& stats = result.stats;
+    
+    message.assign(4, '\0');
+    putInteger(message, result.success, 1);
+    putInteger(message, result.origin, 2);
+    putInteger(message, result.image.size(), 4);
+    message.append((const char *) result.image.data(), result.image.size());
+    
+    for(size_t count : { stats.lines, stats.tokens, stats.statements, stats.symbols, stats.bytes })
+        putInteger(message, count, 8);
+    
+    for(double seconds : { stats.tokenizeTime, stats.parseTime, stats.defineTime, stats.resolveTime, stats.emitTime })
+        putDouble(message, seconds);
+    
+    putInteger(message, result.diagnostics.size(), 4);
+    
+    for(const Diagnostic& diagnostic : result.diagnostics)
+    {
+        putInteger(message, (uint32_t) diagnostic.line, 4);
+        putInteger(message, (uint32_t) diagnostic.column, 4);
+        putInteger(message, diagnostic.message.size(), 4);
+        message += diagnostic.message;
+    }
+}
+
+
+//
+//
+//
+
+static bool decodeResult(std::string_view message, Result& result)
+{
+    Statistics& stats = result.stats;
+    uint64_t success, origin, size, count;
+    
+    if(!getInteger(message, success, 1)  ||  !getInteger(message, origin, 2)  ||  !getInteger(message, size, 4)  ||  message.size() < size)
+        return false;
+    
+    result.success = success;
+    result.origin = origin;
+    result.image.assign(message.begin(), message.begin() + size);
+    message.remove_prefix(size);
+    
+    for(size_t *field : { &stats.lines, &stats.tokens, &stats.statements, &stats.symbols, &stats.bytes })
+    {
+        if(!getInteger(message, count, 8))
+            return false;
+        
+        *field = count;
+    }
+    
+    for(double *field : { &stats.tokenizeTime, &stats.parseTime, &stats.defineTime, &stats.resolveTime, &stats.emitTime })
+    {
+        if(!getDouble(message, *field))
+            return false;
+    }
+    
+    if(!getInteger(message, count, 4))
+        return false;
+    
+    result.diagnostics.clear();
+    
+    for(uint64_t index = 0; index < count; ++index)
+    {
+        uint64_t line, column, length;
+        
+        if(!getInteger(message, line, 4)  ||  !getInteger(message, column, 4)  ||  !getInteger(message, length, 4)  ||  message.size() < length)
+            return false;
+        
+        result.diagnostics.push_back({ (int32_t) line, (int32_t) column, std::string(message.substr(0, length)) });
+        message.remove_prefix(length);
+    }
+    
+    return message.empty();
+}
+
+
+//
+// the whole of size bytes, however many calls that takes
+//
+
+static bool readFully(int descriptor, char *data, size_t size)
+{
+    while(size)
+    {
+        ssize_t count = read(descriptor, data, size);
+        
+        if(count < 0  &&  errno == EINTR)
+            continue;
+        
+        if(count <= 0)
+            return false;
+        
+        data += count;
+        size -= count;
+    }
+    
+    return true;
+}
+
+
+//
+//
+//
+
+static bool writeFully(int descriptor, const char *data, size_t size)
+{
+    while(size)
+    {
+        ssize_t count = write(descriptor, data, size);
+        
+        if(count < 0  &&  errno == EINTR)
+            continue;
+        
+        if(count <= 0)
+            return false;
+        
+        data += count;
+        size -= count;
+    }
+    
+    return true;
+}
+
+
+//
+//
+//
+
+static bool readMessage(int descriptor, std::string& message)
+{
+    char header[4];
+    uint64_t size;
+    std::string_view view(header, sizeof(header));
+    
+    if(!readFully(descriptor, header, sizeof(header))  ||  !getInteger(view, size, 4)  ||  size > SERVER_MAXIMUM_MESSAGE)
+        return false;
+    
+    message.resize(size);
+    return readFully(descriptor, &message[0], size);
+}
+
+
+//
+// messages are built behind four bytes left for their length, so each goes
+// out in one write
+//
+
+static bool writeMessage(int descriptor, std::string& message)
+{
+    uint32_t size = message.size() - 4;
+    
+    for(int index = 0; index < 4; ++index)
+        message[index] = (char) (size >> (index * 8));
+    
+    return writeFully(descriptor, message.data(), message.size());
+}
+
+
+// connections with a request waiting for a thread, and those handed back
+// once it is answered; the threads outlive serve() if it fails, so they
+// share this with it rather than borrow its locals
+struct ConnectionQueue
+{
+    std::mutex mutex;
+    std::condition_variable connectionWaiting;
+    std::deque<int> connections;
+    std::vector<int> answered;
+    int wakeup[2] = { -1, -1 };   // a pipe a thread writes to after handing one back
+};
+
+
+//
+// answers the request waiting on a connection; false when the client hung
+// up or sent garbage, and the connection should be closed
+//
+
+static bool serveRequest(int descriptor, std::string& message, std::string& reply)
+{
+    if(!readMessage(descriptor, message))
+        return false;
+    
+    std::string_view view(message);
+    uint64_t fill, flags, threads, directoryLength;
+    
+    if(!getInteger(view, fill, 1)  ||  !getInteger(view, flags, 1)  ||  !getInteger(view, threads, 2)  ||
+        !getInteger(view, directoryLength, 2)  ||  view.size() < directoryLength)
+        return false;
+    
+    Options options;
+    options.fill = fill;
+    options.threads = threads;
+    options.profile = flags & SERVER_PROFILE;
+    options.singlePass = flags & SERVER_SINGLE_PASS;
+    options.includeDirectory = view.substr(0, directoryLength);
+    view.remove_prefix(directoryLength);
+    
+    Result result;
+    
+    // the server's working directory means nothing to the client
+    if(options.includeDirectory.empty()  ||  options.includeDirectory[0] != '/')
+        result.diagnostics.push_back({ 0, -1, "include directory \"" + options.includeDirectory + "\" is not an absolute path" });
+    else if(flags & SERVER_PATH)
+    {
+        SourceFile source;
+        std::string path(view);
+        
+        if(path.empty()  ||  path[0] != '/')
+            result.diagnostics.push_back({ 0, -1, "input file \"" + path + "\" is not an absolute path" });
+        else if(openSource(path, source))
+            result = Assembler(options).assemble(source.text());
+        else
+            result.diagnostics.push_back({ 0, -1, "error opening input file \"" + path + "\"" });
+    }
+    else
+        result = Assembler(options).assemble(view);
+    
+    encodeResult(result, reply);
+    
+    return writeMessage(descriptor, reply);
+}
+
+
+//
+//
+//
+
+bool serve(const std::string& socketPath)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    
+    if(socketPath.size() >= sizeof(address.sun_path))
+        return false;
+    
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if(listener == -1)
+        return false;
+    
+    // a socket file left behind by a server that died is taken over, one
+    // that a live server still answers on is not
+    if(bind(listener, (const sockaddr *) &address, sizeof(address)) != 0)
+    {
+        ServerConnection probe;
+        
+        if(errno != EADDRINUSE  ||  probe.connect(socketPath)  ||
+            unlink(socketPath.c_str()) != 0  ||  bind(listener, (const sockaddr *) &address, sizeof(address)) != 0)
+        {
+            ::close(listener);
+            return false;
+        }
+    }
+    
+    if(listen(listener, SOMAXCONN) != 0)
+    {
+        ::close(listener);
+        return false;
+    }
+    
+    // a client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    
+    
+    // a fixed set of threads answers requests, so however many connections
+    // a client opens, the threads and their arenas stay bounded. between
+    // requests a connection waits here in poll() rather than hold a thread,
+    // so an idle one never keeps another client waiting
+    std::shared_ptr<ConnectionQueue> queue = std::make_shared<ConnectionQueue>();
+    
+    if(pipe(queue->wakeup) != 0)
+    {
+        ::close(listener);
+        return false;
+    }
+    
+    auto worker = [queue]
+    {
+        std::string message;
+        std::string reply;
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        
+        for(;;)
+        {
+            queue->connectionWaiting.wait(lock, [&] { return !queue->connections.empty(); });
+            
+            int descriptor = queue->connections.front();
+            queue->connections.pop_front();
+            
+            lock.unlock();
+            bool open = serveRequest(descriptor, message, reply);
+            lock.lock();
+            
+            if(!open)
+            {
+                ::close(descriptor);
+                continue;
+            }
+            
+            // one byte in the pipe wakes poll() for all of them, so it
+            // never fills
+            queue->answered.push_back(descriptor);
+            
+            if(queue->answered.size() == 1)
+                writeFully(queue->wakeup[1], "", 1);
+        }
+    };
+    
+    for(unsigned count = std::max(1u, std::thread::hardware_concurrency()); count; --count)
+        std::thread(worker).detach();
+    
+    
+    // the listener, the wakeup pipe, then the connections between requests
+    std::vector<pollfd> descriptors = { { listener, POLLIN, 0 }, { queue->wakeup[0], POLLIN, 0 } };
+    
+    for(;;)
+    {
+        if(poll(descriptors.data(), descriptors.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            
+            break;
+        }
+        
+        // a connection with something to read, or that hung up, goes to a
+        // thread, which finds out which; one answered comes back to wait
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            
+            for(size_t index = 2; index < descriptors.size(); )
+            {
+                if(descriptors[index].revents)
+                {
+                    queue->connections.push_back(descriptors[index].fd);
+                    queue->connectionWaiting.notify_one();
+                    
+                    descriptors[index] = descriptors.back();
+                    descriptors.pop_back();
+                }
+                else
+                    ++index;
+            }
+            
+            if(descriptors[1].revents)
+            {
+                char bytes[256];
+                
+                if(read(queue->wakeup[0], bytes, sizeof(bytes)) <= 0)
+                    break;
+                
+                for(int descriptor : queue->answered)
+                    descriptors.push_back({ descriptor, POLLIN, 0 });
+                
+                queue->answered.clear();
+            }
+        }
+        
+        if(descriptors[0].revents)
+        {
+            int descriptor = accept(listener, nullptr, nullptr);
+            
+            if(descriptor != -1)
+                descriptors.push_back({ descriptor, POLLIN, 0 });
+            else if(errno == EMFILE  ||  errno == ENFILE)
+            {
+                // out of descriptors: wait for a connection to close rather than spin
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            else if(errno != EINTR  &&  errno != ECONNABORTED)
+                break;
+        }
+    }
+    
+    for(size_t index = 2; index < descriptors.size(); ++index)
+        ::close(descriptors[index].fd);
+    
+    ::close(listener);
+    return false;
+}
+
+
+//
+//
+//
+
+ServerConnection::~ServerConnection()
+{
+    close();
+}
+
+
+//
+//
+//
+
+bool ServerConnection::connect(const std::string& socketPath)
+{
+    close();
+    
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    
+    if(socketPath.size() >= sizeof(address.sun_path))
+        return false;
+    
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    
+    m_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if(m_descriptor == -1)
+        return false;
+    
+    if(::connect(m_descriptor, (const sockaddr *) &address, sizeof(address)) != 0)
+    {
+        close();
+        return false;
+    }
+    
+    return true;
+}
+
+
+//
+//
+//
+
+void ServerConnection::close()
+{
+    if(m_descriptor != -1)
+        ::close(m_descriptor);
+    
+    m_descriptor = -1;
+}
+
+
+//
+//
+//
+
+bool ServerConnection::request(const Options& options, uint8_t flags, std::string_view text, Result& result)
+{
+    if(m_descriptor == -1)
+        return false;
+    
+    if(options.profile)
+        flags |= SERVER_PROFILE;
+    
+    if(options.singlePass)
+        flags |= SERVER_SINGLE_PASS;
+    
+    // relative .incbin paths start where they would for an assembly here
+    std::error_code error;
+    std::string directory = (options.includeDirectory.empty() ? std::filesystem::current_path(error) : std::filesystem::absolute(options.includeDirectory, error)).string();
+    
+    if(error  ||  directory.size() > 0xffff)
+        return false;
+    
+    m_message.assign(4, '\0');
+    putInteger(m_message, options.fill, 1);
+    putInteger(m_message, flags, 1);
+    putInteger(m_message, options.threads, 2);
+    putInteger(m_message, directory.size(), 2);
+    m_message += directory;
+    m_message.append(text);
+    
+    if(!writeMessage(m_descriptor, m_message)  ||  !readMessage(m_descriptor, m_message)  ||  !decodeResult(m_message, result))
+    {
+        close();
+        return false;
+    }
+    
+    return true;
+}
+
+
+#else
+
+
+//
+// unix domain sockets are posix only
+//
+
+bool serve(const std::string&)
+{
+    return false;
+}
+
+
+ServerConnection::~ServerConnection()
+{
+}
+
+
+bool ServerConnection::connect(const std::string&)
+{
+    return false;
+}
+
+
+void ServerConnection::close()
+{
+}
+
+
+bool ServerConnection::request(const Options&, uint8_t, std::string_view, Result&)
+{
+    return false;
+}
+
+
+#endif
+
+
+//
+//
+//
+
+bool ServerConnection::assemble(const Options& options, std::string_view source, Result& result)
+{
+    return request(options, 0, source, result);
+}
+
+
+//
+//
+//
+
+bool ServerConnection::assembleFile(const Options& options, const std::string& path, Result& result)
+{
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(path, error);
+    
+    // the server resolves nothing against its own working directory
+    if(error)
+        return false;
+    
+    // like the command line, a file's .incbin paths start in its directory
+    Options fileOptions = options;
+    
+    if(fileOptions.includeDirectory.empty())
+        fileOptions.includeDirectory = absolute.parent_path().string();
+    
+    return request(fileOptions, SERVER_PATH, absolute.string(), result);
+}
+
+
+}  // namespace chip8asm
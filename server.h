@@ -0,0 +1,73 @@
+#ifndef CHIP8ASM_SERVER_H
+#define CHIP8ASM_SERVER_H
+
+#include <string>
+#include <string_view>
+
+#include "chip8asm.h"
+
+
+namespace chip8asm
+{
+
+
+// the protocol spoken over the socket. every message is a 32-bit length
+// followed by that many bytes, all integers little endian.
+//
+//   request:   u8 fill, u8 flags, u16 threads, u16 directory length, the
+//              absolute directory relative .incbin paths start in, then
+//              the source text, or with SERVER_PATH set the absolute path
+//              of a file the server reads; a relative directory or path is
+//              answered with a diagnostic
+//   response:  u8 success, u16 origin, u32 image size, the image,
+//              the statistics as u64 counts and f64 seconds in Statistics
+//              order, u32 diagnostic count, then for each diagnostic
+//              i32 line, i32 column, u32 length and the message
+enum ServerFlagEnum
+{
+    SERVER_PATH = 1,
+    SERVER_PROFILE = 2,
+    SERVER_SINGLE_PASS = 4
+};
+
+
+// listens on a unix domain socket and assembles requests until the process
+// is killed; returns false only when it cannot listen. a connection may send
+// any number of requests, each answered by one of a thread per core, whose
+// arenas stay warm between requests
+bool serve(const std::string& socketPath);
+
+
+// a client connection to serve(), used by one thread at a time
+class ServerConnection
+{
+public:
+    ServerConnection() = default;
+    ~ServerConnection();
+    
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
+    
+    bool connect(const std::string& socketPath);
+    void close();
+    
+    // false when the server cannot be reached or replies with garbage; a
+    // source that fails to assemble still returns true, with the diagnostics
+    // in result. paths are made absolute here, against the client's working
+    // directory, and without Options::includeDirectory .incbin paths start
+    // there too, or for assembleFile() in the file's directory
+    bool assemble(const Options& options, std::string_view source, Result& result);
+    bool assembleFile(const Options& options, const std::string& path, Result& result);
+
+private:
+    bool request(const Options& options, uint8_t flags, std::string_view text, Result& result);
+    
+    int m_descriptor = -1;
+    std::string m_message;
+};
+
+
+}  // namespace chip8asm
+
+
+#endif
@@ -0,0 +1,160 @@
+#include "source.h"
+
+#include <cstdio>
+
+#ifdef CHIP8ASM_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace chip8asm
+{
+
+
+//
+//
+//
+
+SourceFile::~SourceFile()
+{
+#ifdef CHIP8ASM_POSIX
+    if(mapping)
+        munmap(mapping, size);
+#endif
+}
+
+
+#ifdef CHIP8ASM_POSIX
+
+
+//
+// pipes and other unmappable inputs are read in large chunks, to the end
+//
+
+static bool readDescriptor(int descriptor, SourceFile& source)
+{
+    ssize_t count;
+    size_t size = 0;
+    
+    source.buffer.resize(1 << 16);
+    
+    while((count = read(descriptor, &source.buffer[size], source.buffer.size() - size)) != 0)
+    {
+        if(count < 0  &&  errno == EINTR)
+            continue;
+        
+        if(count < 0)
+            return false;
+        
+        size += count;
+        
+        if(size == source.buffer.size())
+            source.buffer.resize(size * 2);
+    }
+    
+    source.buffer.resize(size);
+    source.data = source.buffer.data();
+    source.size = size;
+    return true;
+}
+
+
+#else
+
+
+//
+//
+//
+
+static bool readStream(FILE *file, SourceFile& source)
+{
+    size_t count;
+    size_t size = 0;
+    
+    source.buffer.resize(1 << 16);
+    
+    while((count = fread(&source.buffer[size], 1, source.buffer.size() - size, file)) != 0)
+    {
+        size += count;
+        
+        if(size == source.buffer.size())
+            source.buffer.resize(size * 2);
+    }
+    
+    source.buffer.resize(size);
+    source.data = source.buffer.data();
+    source.size = size;
+    return !ferror(file);
+}
+
+
+#endif
+
+
+//
+//
+//
+
+bool openSource(const std::string& filename, SourceFile& source)
+{
+#ifdef CHIP8ASM_POSIX
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    
+    if(descriptor == -1)
+        return false;
+    
+    struct stat status;
+    
+    if(fstat(descriptor, &status) == 0  &&  S_ISREG(status.st_mode)  &&  status.st_size > 0)
+    {
+        void *mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        
+        if(mapping != MAP_FAILED)
+        {
+            madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+            close(descriptor);
+            
+            source.mapping = mapping;
+            source.data = (const char *) mapping;
+            source.size = status.st_size;
+            return true;
+        }
+    }
+    
+    bool loaded = readDescriptor(descriptor, source);
+    
+    close(descriptor);
+    return loaded;
+#else
+    FILE *file = fopen(filename.c_str(), "rb");
+    
+    if(!file)
+        return false;
+    
+    bool loaded = readStream(file, source);
+    
+    fclose(file);
+    return loaded;
+#endif
+}
+
+
+//
+//
+//
+
+bool readStandardInput(SourceFile& source)
+{
+#ifdef CHIP8ASM_POSIX
+    return readDescriptor(STDIN_FILENO, source);
+#else
+    return readStream(stdin, source);
+#endif
+}
+
+
+}  // namespace chip8asm
@@ -0,0 +1,46 @@
+#ifndef CHIP8ASM_SOURCE_H
+#define CHIP8ASM_SOURCE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__)  ||  defined(__APPLE__)
+#define CHIP8ASM_POSIX
+#endif
+
+
+namespace chip8asm
+{
+
+
+// the whole input file, memory mapped when possible so lines can be
+// tokenized straight out of the page cache
+struct SourceFile
+{
+    const char *data = nullptr;
+    size_t size = 0;
+    
+    void *mapping = nullptr;
+    std::string buffer;
+    
+    SourceFile() = default;
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    
+    ~SourceFile();
+    
+    std::string_view text() const  { return std::string_view(data, size); }
+};
+
+
+bool openSource(const std::string& filename, SourceFile& source);
+
+// reads standard input to its end, in chunks as it arrives
+bool readStandardInput(SourceFile& source);
+
+
+}  // namespace chip8asm
+
+
+#endif
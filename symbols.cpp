@@ -0,0 +1,80 @@
+#include "symbols.h"
+
+#include "tokenizer.h"
+
+
+namespace chip8asm
+{
+
+
+//
+//
+//
+
+uint32_t hashSymbol(std::string_view name)
+{
+    // FNV-1a over the lowercased name, since labels ignore case
+    uint32_t hash = 2166136261u;
+    
+    for(char c : name)
+        hash = (hash ^ (unsigned char) toLowerAscii(c)) * 16777619u;
+    
+    return hash;
+}
+
+
+//
+//
+//
+
+uint32_t SymbolTable::intern(std::string_view name)
+{
+    if(slots.empty())
+    {
+        slots.assign(256, 0);
+        symbols.push_back({ 0, 0, -1, 0, 0, false });
+    }
+    
+    size_t mask = slots.size() - 1;
+    size_t slot = hashSymbol(name) & mask;
+    
+    // linear probing; the table is kept at most half full
+    while(slots[slot] != SYMBOL_NONE)
+    {
+        if(equalsIgnoreCase(name, this->name(slots[slot])))
+            return slots[slot];
+        
+        slot = (slot + 1) & mask;
+    }
+    
+    uint32_t id = symbols.size();
+    symbols.push_back({ (uint32_t) names.size(), (uint32_t) name.size(), -1, 0, 0, false });
+    
+    for(char c : name)
+        names.push_back(toLowerAscii(c));
+    
+    slots[slot] = id;
+    
+    
+    // grow and rehash once the load factor passes one half
+    if(symbols.size() * 2 > slots.size())
+    {
+        slots.assign(slots.size() * 2, SYMBOL_NONE);
+        mask = slots.size() - 1;
+        
+        for(uint32_t index = 1; index < symbols.size(); ++index)
+        {
+            slot = hashSymbol(this->name(index)) & mask;
+            
+            while(slots[slot] != SYMBOL_NONE)
+                slot = (slot + 1) & mask;
+            
+            slots[slot] = index;
+        }
+    }
+    
+    return id;
+}
+
+
+}  // namespace chip8asm
@@ -0,0 +1,60 @@
+#ifndef CHIP8ASM_SYMBOLS_H
+#define CHIP8ASM_SYMBOLS_H
+
+#include <cstdint>
+#include <string_view>
+
+#include "arena.h"
+
+
+namespace chip8asm
+{
+
+
+// label names are interned once into dense ids; statements refer to labels
+// by id, so resolving one is an array index
+inline constexpr uint32_t SYMBOL_NONE = 0;
+
+// marks a label value as relative to the start of a chunk being parsed on
+// its own; cleared once the chunk's base address is known. it sits above
+// every offset, $10000 at the very end of memory included
+inline constexpr int SYMBOL_RELATIVE = 0x20000;
+
+struct Symbol
+{
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int value;           // -1 until the label is defined
+    int line;            // first line that referred to the label
+    uint32_t fixups;     // single-pass references waiting for the label, 0 for none
+    bool constant;       // defined by .equ rather than as a label
+};
+
+
+struct SymbolTable
+{
+    ArenaVector<char> names;        // lowercased names, back to back
+    ArenaVector<Symbol> symbols;    // indexed by id, id 0 is SYMBOL_NONE
+    ArenaVector<uint32_t> slots;    // open-addressed hash of ids, 0 is empty
+    
+    explicit SymbolTable(Arena *arena = nullptr)
+        : names(arena), symbols(arena), slots(arena) {}
+    
+    size_t size() const  { return symbols.empty() ? 0 : symbols.size() - 1; }
+    
+    std::string_view name(uint32_t id) const
+    {
+        return std::string_view(names.data() + symbols[id].nameOffset, symbols[id].nameLength);
+    }
+    
+    uint32_t intern(std::string_view name);
+};
+
+
+uint32_t hashSymbol(std::string_view name);
+
+
+}  // namespace chip8asm
+
+
+#endif
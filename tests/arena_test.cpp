@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <string>
+
+#include "context.h"
+
+
+// a context reused for assembly after assembly keeps its arena warm, but
+// not at the size of the largest source it ever saw
+int main()
+{
+    chip8asm::Context context;
+    chip8asm::Options options;
+    int failures = 0;
+    
+    std::string source;
+    
+    for(int index = 0; index < 1000000; ++index)
+        source += "label" + std::to_string(index) + ":\n";
+    
+    context.reset(options);
+    
+    if(!chip8asm::parseSource(context, source))
+    {
+        printf("the large source should parse\n");
+        return 1;
+    }
+    
+    size_t peak = context.arena.capacity();
+    
+    if(peak <= chip8asm::ARENA_RETAINED_SIZE)
+    {
+        printf("the large source should need more than the arena keeps, only used %zu bytes\n", peak);
+        ++failures;
+    }
+    
+    context.reset(options);
+    
+    if(context.arena.capacity() > chip8asm::ARENA_RETAINED_SIZE)
+    {
+        printf("reset kept %zu of %zu bytes\n", context.arena.capacity(), peak);
+        ++failures;
+    }
+    
+    
+    // and a small one after it neither grows the arena nor fails
+    if(!chip8asm::parseSource(context, "start: cls\njp start\n")  ||  context.arena.capacity() > chip8asm::ARENA_RETAINED_SIZE)
+    {
+        printf("a small source after the large one should parse in what was kept\n");
+        ++failures;
+    }
+    
+    return failures ? 1 : 0;
+}
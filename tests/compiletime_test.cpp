@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "chip8asm.h"
+#include "compiletime.h"
+
+
+// compiletime.h against the runtime assembler: the same images, and errors
+// on the same lines. assembleSource() is constexpr, so it runs here as it
+// runs in the compiler, but throws its errors instead of stopping the build
+static int g_failures = 0;
+
+
+// test.s
+constexpr char SAMPLE[] = R"(;
+; test file
+;
+                
+                .ORG $200
+                
+                cls
+                ret
+                jp $0210
+                jp next
+next:           call next2
+next2:          se v0, $ff
+                sne v1, $ff
+                se v2, v3
+                ld v4, $ff
+                add v5, $ff
+                ld v6, v7
+                or v8, v9
+                and va, vb
+                xor vc, vd
+                add ve, vf
+                sub v0, v1
+                shr v2
+                subn v3, v4
+                shl v5
+                sne v6, v7
+                ld i, next
+                jp v0, next2
+                rnd v8, $ff
+                drw v9, va, $f
+                skp vb
+                sknp vc
+                ld vd, dt
+                ld ve, k
+                ld dt, vf
+                ld st, v0
+                add i, v1
+                ld f, v2
+                ld b, v3
+                ld [i], v4
+                ld v5, [i]
+)";
+
+
+constexpr char EXPRESSIONS[] = R"(
+.equ WIDTH, 64
+.equ HEIGHT, WIDTH / 2
+.equ MASK, (1 << 4) - 1
+start:
+    ld v0, WIDTH - 1
+    ld v1, HEIGHT-1
+    add v2, -1
+    ld i, sprite + 2
+    jp start
+    ld v3, lo(table)
+    ld v4, hi(table)
+    rnd v5, MASK
+    se v6, ~0 & $ff
+    drw v0, v1, MASK / 3
+.equ SIZE, end - table
+    ld v7, SIZE & $ff
+table:
+    .byte 1, 2, WIDTH | 1, -1, table - start
+    .word table, $1234 >> 4, SIZE * 2
+sprite:
+    .byte %11110000, $90 , 3 * (4 + 5)
+    .org $300 + 2 * 8
+    .fill HEIGHT/8, MASK
+    .space 2
+end:
+ld v0, hi (x) + lo (x)
+.byte 1, 2 * 3, -1
+x:
+)";
+
+
+//
+// assembles source both ways and reports where they differ
+//
+
+static void compare(const char *name, std::string_view source, uint8_t fill = 0)
+{
+    chip8asm::Options options;
+    options.fill = fill;
+    
+    chip8asm::Result result = chip8asm::Assembler(options).assemble(source);
+    int origin = 0;
+    
+    try
+    {
+        std::vector<uint8_t> image = chip8asm::compiletime::assembleSource(source, fill, origin);
+        
+        if(!result.success)
+            printf("%s: assembles at compile time only; at runtime \"%s\" on line %d\n", name, result.diagnostics[0].message.c_str(), result.diagnostics[0].line);
+        else if(image != result.image  ||  origin != result.origin)
+            printf("%s: images differ, %zu bytes at $%04x at compile time and %zu at $%04x at runtime\n", name, image.size(), origin, result.image.size(), result.origin);
+        else
+            return;
+    }
+    catch(const chip8asm::compiletime::AssemblyError& error)
+    {
+        if(result.success)
+            printf("%s: assembles at runtime only; at compile time \"%s\" on line %d\n", name, error.message, error.line);
+        else if(error.line != result.diagnostics[0].line)
+            printf("%s: \"%s\" on line %d at compile time, \"%s\" on line %d at runtime\n", name, error.message, error.line, result.diagnostics[0].message.c_str(), result.diagnostics[0].line);
+        else
+            return;
+    }
+    
+    ++g_failures;
+}
+
+
+//
+// an image built by the compiler against the runtime's
+//
+
+template<size_t Size>
+static void compareRom(const char *name, const std::array<uint8_t, Size>& rom, uint16_t origin, std::string_view source)
+{
+    chip8asm::Result result = chip8asm::Assembler().assemble(source);
+    
+    if(result.success  &&  result.origin == origin  &&  result.image == std::vector<uint8_t>(rom.begin(), rom.end()))
+        return;
+    
+    printf("%s: the compiled rom differs from the runtime image\n", name);
+    ++g_failures;
+}
+
+
+int main()
+{
+    // built by the compiler itself
+    constexpr auto sampleRom = chip8asm::assemble<SAMPLE>();
+    constexpr auto expressionRom = chip8asm::assemble<EXPRESSIONS>();
+    
+    compareRom("sample rom", sampleRom, chip8asm::imageOrigin<SAMPLE>(), SAMPLE);
+    compareRom("expression rom", expressionRom, chip8asm::imageOrigin<EXPRESSIONS>(), EXPRESSIONS);
+    
+    
+    compare("sample", SAMPLE);
+    compare("expressions", EXPRESSIONS);
+    compare("forward references", "start: jp end\n  call sub\n  .org $300\nsub: ret\nend: jp start\n");
+    compare("gaps", ".org $200\ncls\n.org $210\n.byte 1\n.org $208\n.word 2\n", 0xaa);
+    compare("end of memory", ".org $fffe\ncls\nend:\n");
+    compare("data", ".space 3\n.byte 1, -1, $ff\n.word -1, $fff\n.fill 2, 7\n");
+    compare("constant naming a label", ".equ B, here + 1\nhere: ld i, B\n");
+    compare("empty", "; nothing\n\n");
+    
+    
+    // errors must fail both ways, on the same line
+    compare("unknown instruction", "cls\nbogus v0\n");
+    compare("bad operands", "ld v0, 256\n");
+    compare("undefined label", "cls\njp nowhere\n");
+    compare("label out of range", "ld i, far\n.org $1000\nfar:\n");
+    compare("past the end", ".org $fffe\ncls\ncls\n");
+    compare("fill past the end", ".fill $10000, 1\n");
+    compare("overlap", "cls\ncls\n.org $202\n\nret\n");
+    compare("constant twice", ".equ A, 1\n.equ A, 2\n");
+    compare("constant over label", "a: cls\n.equ a, 1\n");
+    compare("label over constant", ".equ a, 1\na: cls\n");
+    compare("label twice", "jp x\nx: cls\nx: ret\n");
+    compare("division by zero", "cls\n.byte 1 / 0\n");
+    compare("bad expression", "ld v0, (1 +\n");
+    compare("constant out of range", ".equ B, here + 1\ncls\nld v0, B\nhere:\n");
+    compare("bad origin", "cls\n.org\n");
+    compare("colon", "cls\n: cls\n");
+    compare("incbin", "cls\n.incbin \"missing.bin\"\n");
+    
+    return g_failures ? 1 : 0;
+}
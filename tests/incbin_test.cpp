@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "chip8asm.h"
+#include "server.h"
+#include "source.h"
+
+
+// .incbin paths start in the including source's directory, here and on a
+// server that runs somewhere else
+static int g_failures = 0;
+
+
+//
+//
+//
+
+static void expectImage(const char *name, const chip8asm::Result& result, const std::string& image)
+{
+    if(result.success  &&  std::string(result.image.begin(), result.image.end()) == image)
+        return;
+    
+    printf("%s: expected \"%s\", got", name, image.c_str());
+    
+    if(result.success)
+        printf(" \"%s\"\n", std::string(result.image.begin(), result.image.end()).c_str());
+    else
+        printf(" \"%s\"\n", result.diagnostics.empty() ? "no diagnostic" : result.diagnostics[0].message.c_str());
+    
+    ++g_failures;
+}
+
+
+int main()
+{
+    namespace fs = std::filesystem;
+    
+    fs::path directory = fs::temp_directory_path() / "chip8asm_incbin_test";
+    fs::remove_all(directory);
+    fs::create_directories(directory / "sprites");
+    
+    std::ofstream(directory / "sprites" / "ball.bin") << "ball";
+    std::ofstream(directory / "game.s") << ".incbin \"sprites/ball.bin\"\n";
+    
+    const char *source = ".incbin \"sprites/ball.bin\"\n";
+    chip8asm::Options options;
+    options.includeDirectory = directory.string();
+    
+    expectImage("include directory", chip8asm::Assembler(options).assemble(source), "ball");
+    
+    std::string absolute = ".incbin \"" + (directory / "sprites" / "ball.bin").string() + "\"\n";
+    options.includeDirectory = "/nonexistent";
+    expectImage("absolute path", chip8asm::Assembler(options).assemble(absolute), "ball");
+
+
+#ifdef CHIP8ASM_POSIX
+    // the server runs from the root, the client from the source's directory
+    std::string socketPath = (directory / "socket").string();
+    fs::current_path("/");
+    std::thread([socketPath] { chip8asm::serve(socketPath); }).detach();
+    fs::current_path(directory);
+    
+    chip8asm::ServerConnection connection;
+    
+    for(int attempt = 0; attempt < 100  &&  !connection.connect(socketPath); ++attempt)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    
+    chip8asm::Result result;
+    
+    if(!connection.assemble(chip8asm::Options(), source, result))
+    {
+        printf("server: no reply\n");
+        ++g_failures;
+    }
+    else
+        expectImage("server text", result, "ball");
+    
+    fs::current_path("/");
+    
+    if(!connection.assembleFile(chip8asm::Options(), (directory / "game.s").string(), result))
+    {
+        printf("server: no reply\n");
+        ++g_failures;
+    }
+    else
+        expectImage("server file", result, "ball");
+#endif
+    
+    fs::remove_all(directory);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "generator.h"
+#include "incremental.h"
+
+
+// random edits to a generated source, each assembled both incrementally and
+// in full; the two must agree on the image or on the first diagnostic
+static int g_failures = 0;
+
+
+//
+//
+//
+
+static std::vector<std::string> splitLines(const std::string& source)
+{
+    std::vector<std::string> lines;
+    
+    for(size_t start = 0; start < source.size(); )
+    {
+        size_t end = source.find('\n', start);
+        end = end == std::string::npos ? source.size() : end;
+        
+        lines.push_back(source.substr(start, end - start));
+        start = end + 1;
+    }
+    
+    return lines;
+}
+
+
+//
+//
+//
+
+static bool sameResult(const chip8asm::Result& a, const chip8asm::Result& b)
+{
+    if(a.success != b.success)
+        return false;
+    
+    if(a.success)
+        return a.image == b.image  &&  a.origin == b.origin;
+    
+    if(a.diagnostics.size() != b.diagnostics.size())
+        return false;
+    
+    for(size_t index = 0; index < a.diagnostics.size(); ++index)
+    {
+        if(a.diagnostics[index].message != b.diagnostics[index].message  ||  a.diagnostics[index].line != b.diagnostics[index].line)
+            return false;
+    }
+    
+    return true;
+}
+
+
+//
+// a label defined at the start of the line, if any
+//
+
+static std::string lineLabel(const std::string& line)
+{
+    size_t colon = line.find(':');
+    
+    if(colon == std::string::npos  ||  line.empty()  ||  line[0] == ' '  ||  line[0] == ';')
+        return std::string();
+    
+    return line.substr(0, colon);
+}
+
+
+//
+// with valid set, the edits are undone wherever they would make the source
+// fail, so most updates take the incremental path
+//
+
+static void fuzz(uint32_t seed, bool valid, const std::string& binaryPath)
+{
+    std::mt19937 random(seed);
+    
+    GeneratorOptions generatorOptions;
+    generatorOptions.lines = 300;
+    generatorOptions.seed = random();
+    
+    std::vector<std::string> lines = splitLines(generateSource(generatorOptions));
+    std::string incbin = "  .incbin \"" + binaryPath + "\"";
+    
+    // pieces that exercise labels, .org, sizes and expressions
+    std::vector<std::string> snippets =
+    {
+        "  cls", "  .byte 1, 2, 3", "  .word $1234", "extra: ld v1, 3", "  jp extra", "  call loop1", "  .org $0a00",
+        "loop1: ret", "  ld i, sprite1", "", "; comment", "bad line here", "  .byte 1", "twice: .byte 7", "twice: .byte 8",
+        "  jp twice", "  drw v1, v2, 5", "lbl2:", "  jp lbl2", "  .org $fffe", "  .word 1", "  .fill 3, 9", "  .space 2",
+        incbin, "  .fill 0, 1", "  ld v0, lo(extra) + 1", "  ld i, loop1 + 2", "  .byte hi(lbl2), twice - extra",
+        "  .equ KK, 3", "  .equ DD, lbl2 - extra", "  ld v1, KK * 2", "  .word extra + KK", "  se v2, (lbl2 - loop1) & $ff"
+    };
+    
+    std::vector<std::string> initialLabels;
+    
+    for(const std::string& line : lines)
+    {
+        if(!lineLabel(line).empty())
+            initialLabels.push_back(lineLabel(line));
+    }
+    
+    chip8asm::IncrementalAssembler incremental;
+    chip8asm::Assembler assembler;
+    int mismatches = 0;
+    
+    for(int iteration = 0; iteration < 2000; ++iteration)
+    {
+        int kind = random() % 4;
+        size_t at = lines.empty() ? 0 : random() % (lines.size() + 1);
+        int count = 1 + random() % 3;
+        
+        for(int edit = 0; edit < count; ++edit)
+        {
+            if(kind == 0  ||  lines.empty())
+                lines.insert(lines.begin() + std::min(at, lines.size()), snippets[random() % snippets.size()]);
+            else if(kind == 1  &&  at < lines.size())
+                lines.erase(lines.begin() + at);
+            else if(kind == 2  &&  at < lines.size())
+                lines[at] = snippets[random() % snippets.size()];
+            else if(at < lines.size())
+                lines[at] = lines[random() % lines.size()];
+        }
+        
+        if(valid  ||  random() % 3 == 0)
+        {
+            for(std::string& line : lines)
+            {
+                if(line == "bad line here"  ||  line == "  .org $fffe"  ||  line == "twice: .byte 8")
+                    line.clear();
+            }
+        }
+        
+        if(valid)
+        {
+            std::set<std::string> defined;
+            bool origin = false;
+            
+            for(std::string& line : lines)
+            {
+                if(line == "  .org $0a00")
+                {
+                    if(origin)
+                        line.clear();
+                    
+                    origin = true;
+                }
+                
+                std::string label = line.rfind("  .equ ", 0) == 0 ? line.substr(7, 2) : lineLabel(line);
+                
+                if(!label.empty()  &&  !defined.insert(label).second)
+                    line = "  cls";
+            }
+            
+            if(!defined.count("KK"))
+                lines.insert(lines.begin() + random() % (lines.size() + 1), "  .equ KK, 3");
+            
+            for(const std::string& label : initialLabels)
+            {
+                if(!defined.count(label))
+                    lines.insert(lines.begin() + random() % (lines.size() + 1), label + ": .byte 0");
+            }
+            
+            for(const char *label : { "extra", "loop1", "lbl2", "twice" })
+            {
+                if(!defined.count(label))
+                    lines.insert(lines.begin() + random() % (lines.size() + 1), std::string(label) + ": cls");
+            }
+        }
+        
+        std::string source;
+        
+        for(const std::string& line : lines)
+            source += line + "\n";
+        
+        if(random() % 10 == 0)
+            source.pop_back();
+        
+        chip8asm::Result patched = incremental.update(source);
+        chip8asm::Result full = assembler.assemble(source);
+        
+        if(!sameResult(patched, full)  &&  mismatches++ < 5)
+            printf("seed %u iteration %d: incremental %s, full %s\n", seed, iteration, patched.success ? "succeeded" : "failed", full.success ? "succeeded" : "failed");
+    }
+    
+    g_failures += mismatches;
+}
+
+
+int main()
+{
+    namespace fs = std::filesystem;
+    
+    fs::path binaryPath = fs::temp_directory_path() / "chip8asm_incremental_test.bin";
+    std::ofstream(binaryPath) << "ab";
+    
+    for(uint32_t seed = 1; seed <= 4; ++seed)
+        fuzz(seed, seed % 2 == 0, binaryPath.string());
+    
+    fs::remove(binaryPath);
+    return g_failures ? 1 : 0;
+}
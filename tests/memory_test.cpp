@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <string>
+
+#include "chip8asm.h"
+#include "incremental.h"
+
+
+// statements that would run past $ffff or overlap others are errors on
+// their own line, in every way of assembling a source, as are names defined
+// twice in a source parsed in parallel
+static int g_failures = 0;
+
+
+//
+//
+//
+
+static void expectError(const char *name, const chip8asm::Result& result, int line, const char *message)
+{
+    if(!result.success  &&  !result.diagnostics.empty()  &&  result.diagnostics[0].line == line  &&  result.diagnostics[0].message == message)
+        return;
+    
+    printf("%s: expected \"%s\" on line %d, got", name, message, line);
+    
+    if(result.diagnostics.empty())
+        printf(" %s\n", result.success ? "success" : "no diagnostic");
+    else
+        printf(" \"%s\" on line %d\n", result.diagnostics[0].message.c_str(), result.diagnostics[0].line);
+    
+    ++g_failures;
+}
+
+
+//
+//
+//
+
+static void expectError(const char *name, const std::string& source, int line, const char *message)
+{
+    chip8asm::Options options;
+    
+    expectError(name, chip8asm::Assembler(options).assemble(source), line, message);
+    
+    options.singlePass = true;
+    expectError(name, chip8asm::Assembler(options).assemble(source), line, message);
+    
+    chip8asm::IncrementalAssembler incremental;
+    expectError(name, incremental.update(source), line, message);
+}
+
+
+int main()
+{
+    const char *pastEnd = "statement extends past the end of memory";
+    
+    expectError("instruction", ".org $fffe\ncls\ncls\n", 3, pastEnd);
+    expectError("straddling instruction", ".org $ffff\ncls\n", 2, pastEnd);
+    expectError("byte", ".org $ffff\n.byte 1\n.byte 2\n", 3, pastEnd);
+    expectError("word", ".org $fffe\n.word 1, 2\n", 2, pastEnd);
+    expectError("label word", ".org $fffe\nhere: .word here, here\n", 2, pastEnd);
+    expectError("fill", ".org $ff00\n.fill 257, 1\n", 2, pastEnd);
+    expectError("space", ".space $fe01\n", 1, pastEnd);
+    expectError("whole memory fill", ".fill $10000, 1\n", 1, pastEnd);
+    
+    
+    const char *overlaps = "statement at $0202 overlaps previously emitted bytes";
+    
+    expectError("overlap", "cls\ncls\n.org $202\n\nret\n", 5, overlaps);
+    expectError("overlapping block", "cls\ncls\n.org $201\n.byte 1, 2, 3\n", 4, "statement at $0201 overlaps previously emitted bytes");
+    expectError("overlapping label", "cls\ncls\n.org $202\n\njp there\nthere:\n", 5, overlaps);
+    
+    
+    // a source that fills memory exactly is fine, and a label may mark the end
+    chip8asm::Result full = chip8asm::Assembler(chip8asm::Options()).assemble(".org $fffe\ncls\nend:\n");
+    
+    if(!full.success  ||  full.origin != 0xfffe  ||  full.image.size() != 2)
+    {
+        printf("a source ending at $ffff should assemble\n");
+        ++g_failures;
+    }
+    
+    full = chip8asm::Assembler(chip8asm::Options()).assemble(".org 0\n.fill $10000, 1\n");
+    
+    if(!full.success  ||  full.origin != 0  ||  full.image.size() != 0x10000)
+    {
+        printf("a fill of all memory should assemble\n");
+        ++g_failures;
+    }
+    
+    
+    // chunks parsed in parallel only overflow once they are laid end to end
+    std::string source = ".org $f000\n";
+    std::string padding(120, ' ');
+    
+    for(int count = 0; count <= 0x1000 / 2; ++count)
+        source += "cls    ;" + padding + "\n";
+    
+    chip8asm::Options options;
+    options.threads = 4;
+    expectError("parallel", chip8asm::Assembler(options).assemble(source), 0x1000 / 2 + 2, pastEnd);
+    
+    source += ".org $f000\n\ncls\n";
+    source.replace(0, 10, ".org $e000");
+    expectError("parallel overlap", chip8asm::Assembler(options).assemble(source), 0x1000 / 2 + 5, "statement at $f000 overlaps previously emitted bytes");
+    
+    // and a name only clashes once their labels are merged
+    source = "foo:\n";
+    
+    for(int count = 0; count < 0x1000 / 2; ++count)
+        source += "cls    ;" + padding + "\n";
+    
+    source += ".equ foo, 5\n";
+    expectError("parallel constant", chip8asm::Assembler(options).assemble(source), 0x1000 / 2 + 2, "'foo' is already defined");
+    
+    source.replace(source.size() - 12, 12, "foo: cls\n");
+    expectError("parallel label", chip8asm::Assembler(options).assemble(source), 0x1000 / 2 + 2, "label 'foo' is already defined");
+    
+    
+    // an edit that pushes the lines after it past the end
+    chip8asm::IncrementalAssembler incremental;
+    incremental.update(".org $fffc\nstart:\ncls\ncls\n");
+    expectError("incremental edit", incremental.update(".org $fffc\nstart: cls\ncls\ncls\n"), 4, pastEnd);
+    
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "chip8asm.h"
+#include "generator.h"
+#include "source.h"
+
+
+// --single-pass against the usual two passes: the same image for every
+// source that assembles, and the same first error for one that does not
+static int g_failures = 0;
+
+
+//
+//
+//
+
+static chip8asm::Result assemble(std::string_view source, bool singlePass)
+{
+    chip8asm::Options options;
+    options.singlePass = singlePass;
+    
+    return chip8asm::Assembler(options).assemble(source);
+}
+
+
+//
+//
+//
+
+static void compare(const char *name, std::string_view source, bool succeeds)
+{
+    chip8asm::Result twoPass = assemble(source, false);
+    chip8asm::Result singlePass = assemble(source, true);
+    
+    if(twoPass.success != succeeds)
+        printf("%s: two passes %s\n", name, twoPass.success ? "succeeded" : ("failed: " + twoPass.diagnostics[0].message).c_str());
+    else if(singlePass.success != succeeds)
+        printf("%s: single pass %s\n", name, singlePass.success ? "succeeded" : ("failed: " + singlePass.diagnostics[0].message).c_str());
+    else if(succeeds  &&  (singlePass.image != twoPass.image  ||  singlePass.origin != twoPass.origin))
+        printf("%s: images differ\n", name);
+    else if(!succeeds  &&  (singlePass.diagnostics[0].line != twoPass.diagnostics[0].line  ||  singlePass.diagnostics[0].message != twoPass.diagnostics[0].message))
+    {
+        printf("%s: \"%s\" on line %d in two passes, \"%s\" on line %d in one\n", name, twoPass.diagnostics[0].message.c_str(), twoPass.diagnostics[0].line,
+            singlePass.diagnostics[0].message.c_str(), singlePass.diagnostics[0].line);
+    }
+    else
+        return;
+    
+    ++g_failures;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // the repo's sample, when ctest passes its path
+    chip8asm::SourceFile sample;
+    
+    if(argc > 1  &&  !chip8asm::openSource(argv[1], sample))
+    {
+        printf("error opening \"%s\"\n", argv[1]);
+        return 1;
+    }
+    
+    if(argc > 1)
+        compare("sample", sample.text(), true);
+    
+    GeneratorOptions generatorOptions;
+    generatorOptions.lines = 5000;
+    compare("generated", generateSource(generatorOptions), true);
+    
+    generatorOptions.expressions = true;
+    compare("generated expressions", generateSource(generatorOptions), true);
+    
+    
+    // forward references, patched as their labels are defined
+    compare("forward jump", "jp end\ncls\nend: ret\n", true);
+    compare("forward chain", "jp x\ncall x\nld i, x\njp y\nx: cls\ny: ret\n", true);
+    compare("forward data", ".word end, end + 2\n.byte lo(end), hi(end)\nend:\n", true);
+    compare("forward across org", "jp far\n.org $400\nfar: jp near\n.org $300\nnear: ret\n", true);
+    compare("forward expression", "ld i, table + 2 * 3\nld v0, (table - start) & $ff\nstart: cls\ntable: .byte 1\n", true);
+    compare("constants", ".equ THREE, 3\n.equ SIX, THREE * 2\nld v0, SIX - THREE\n.byte THREE, SIX\n", true);
+    compare("label at the end of memory", ".org $fffe\ncls\nend:\n.org $200\n.byte hi(end - 2), lo(end - 2)\n", true);
+    
+    
+    // and errors, one to a source
+    compare("undefined", "cls\njp nowhere\n", false);
+    compare("undefined in expression", "cls\nld i, nowhere + 1\n", false);
+    compare("out of range", "ld i, far\n.org $1000\nfar:\n", false);
+    compare("expression out of range", "ld v0, end\ncls\nend:\n", false);
+    compare("division by zero", ".byte 1 / (end - end)\nend:\n", false);
+    compare("overlap", "cls\ncls\n.org $202\nret\n", false);
+    compare("past the end", ".org $fffe\ncls\ncls\n", false);
+    compare("constant twice", ".equ ONE, 1\n.equ ONE, 2\n", false);
+    compare("label twice", "jp x\nx: cls\nx: ret\n", false);
+    compare("label and constant", "x: cls\n.equ x, 1\n", false);
+    compare("bad operands", "cls\nld v0, 256\n", false);
+    
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+
+namespace chip8asm
+{
+
+
+//
+//
+//
+
+ThreadPool::ThreadPool(int threadCount)
+    : m_queued(0), m_pending(0), m_nextWorker(0), m_stopping(false)
+{
+    if(threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    
+    for(int index = 0; index < threadCount; ++index)
+        m_workers.emplace_back(new Worker);
+    
+    for(int index = 0; index < threadCount; ++index)
+        m_threads.emplace_back(&ThreadPool::run, this, index);
+}
+
+
+//
+//
+//
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    
+    m_workAvailable.notify_all();
+    
+    for(std::thread& thread : m_threads)
+        thread.join();
+}
+
+
+//
+//
+//
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    // spread tasks round-robin; stealing evens out whatever imbalance is left
+    Worker& worker = *m_workers[m_nextWorker++ % m_workers.size()];
+    
+    ++m_pending;
+    
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_queued;
+    }
+    
+    m_workAvailable.notify_one();
+}
+
+
+//
+//
+//
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workDone.wait(lock, [this] { return m_pending == 0; });
+}
+
+
+//
+//
+//
+
+bool ThreadPool::takeTask(int index, std::function<void()>& task)
+{
+    {
+        Worker& own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        
+        if(!own.tasks.empty())
+        {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    for(size_t step = 1; step < m_workers.size(); ++step)
+    {
+        Worker& victim = *m_workers[(index + step) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        
+        if(!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+
+//
+//
+//
+
+void ThreadPool::run(int index)
+{
+    std::function<void()> task;
+    
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workAvailable.wait(lock, [this] { return m_stopping  ||  m_queued > 0; });
+            
+            if(m_queued == 0)
+                return;
+            
+            --m_queued;
+        }
+        
+        // a task is reserved for us, though it may sit in another deque
+        while(!takeTask(index, task))
+            std::this_thread::yield();
+        
+        task();
+        task = nullptr;
+        
+        if(--m_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_workDone.notify_all();
+        }
+    }
+}
+
+
+}  // namespace chip8asm
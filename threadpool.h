@@ -0,0 +1,62 @@
+#ifndef CHIP8ASM_THREADPOOL_H
+#define CHIP8ASM_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace chip8asm
+{
+
+
+// fixed set of worker threads, each with its own task deque; a worker takes
+// tasks from the front of its own deque and, once that runs dry, steals from
+// the back of the others
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount = 0);   // 0 means one per core
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    int threadCount() const  { return (int) m_threads.size(); }
+    
+    void submit(std::function<void()> task);
+    void wait();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    
+    bool takeTask(int index, std::function<void()>& task);
+    void run(int index);
+    
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+    
+    size_t m_queued;                   // submitted but not yet taken, guarded by m_mutex
+    std::atomic<size_t> m_pending;     // submitted but not yet finished
+    std::atomic<int> m_nextWorker;
+    bool m_stopping;
+};
+
+
+}  // namespace chip8asm
+
+
+#endif
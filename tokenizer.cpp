@@ -0,0 +1,160 @@
+#include "tokenizer.h"
+
+#include <cstring>
+
+#include "context.h"
+#include "scanner.h"
+
+
+namespace chip8asm
+{
+
+
+//
+// compares text against a name that is already lowercase
+//
+
+bool equalsIgnoreCase(std::string_view text, std::string_view lowercase)
+{
+    if(text.size() != lowercase.size())
+        return false;
+    
+    for(size_t index = 0; index < text.size(); ++index)
+    {
+        if(toLowerAscii(text[index]) != lowercase[index])
+            return false;
+    }
+    
+    return true;
+}
+
+
+//
+// finds tokens a block of bytes at a time, skipping whole runs of delimiters
+// or token characters with one bit scan
+//
+
+static bool addToken(Context& context, TokenList& tokens, std::string_view line, int start, int end)
+{
+    if(tokens.count == MAX_TOKENS)
+    {
+        context.error(context.lineNumber, -1, "too many tokens");
+        return false;
+    }
+    
+    tokens.tokens[tokens.count++] = { start, line.substr(start, end - start), std::string_view(), TOKEN_SYMBOL, 0 };
+    return true;
+}
+
+
+//
+//
+//
+
+bool split(Context& context, std::string_view line, TokenList& tokens)
+{
+    const ScanKernels& kernels = scanKernels();
+    char padded[SCAN_BLOCK_SIZE];
+    size_t length = line.size();
+    int start = -1;
+    
+    tokens.clear();
+    
+    for(size_t base = 0; base < length; base += SCAN_BLOCK_SIZE)
+    {
+        // the last block of the line is padded so the kernel never reads past it
+        const char *data = line.data() + base;
+        size_t blockSize = length - base;
+        uint64_t valid = ~(uint64_t) 0;
+        
+        if(blockSize < SCAN_BLOCK_SIZE)
+        {
+            memcpy(padded, data, blockSize);
+            memset(padded + blockSize, 0, SCAN_BLOCK_SIZE - blockSize);
+            
+            data = padded;
+            valid = ((uint64_t) 1 << blockSize) - 1;
+        }
+        
+        ScanMasks masks;
+        kernels.classify(data, masks);
+        
+        // a comment ends the line
+        uint64_t semicolons = masks.semicolons & valid;
+        
+        if(semicolons)
+        {
+            valid &= (semicolons & (0 - semicolons)) - 1;
+            length = base + countTrailingZeros(semicolons);
+        }
+        
+        uint64_t colons = masks.colons & valid;
+        uint64_t boundaries = (masks.delimiters & valid) | colons;
+        uint64_t characters = ~boundaries & valid;
+        
+        for(int position = 0; position < (int) SCAN_BLOCK_SIZE; )
+        {
+            uint64_t ahead = ~(uint64_t) 0 << position;
+            
+            if(start == -1)
+            {
+                uint64_t next = (characters | colons) & ahead;
+                
+                if(!next)
+                    break;
+                
+                position = countTrailingZeros(next);
+                
+                if((colons >> position) & 1)
+                {
+                    context.error(context.lineNumber, (int) base + position, "label name must preceed colon");
+                    return false;
+                }
+                
+                start = (int) base + position;
+            }
+            else
+            {
+                uint64_t next = boundaries & ahead;
+                
+                if(!next)
+                    break;
+                
+                position = countTrailingZeros(next);
+                
+                // the colon stays on the label so the parser can recognize it
+                if((colons >> position) & 1)
+                    ++position;
+                
+                if(!addToken(context, tokens, line, start, (int) base + position))
+                    return false;
+                
+                start = -1;
+            }
+        }
+    }
+    
+    if(start != -1  &&  !addToken(context, tokens, line, start, (int) length))
+        return false;
+    
+    
+    // lowercase the tokenized part of the line in one go for matching, then
+    // settle what each token is so handlers only check operand shapes
+    if(tokens.lowercase.size() < length)
+        tokens.lowercase.resize(length);
+    
+    kernels.lower(line.data(), &tokens.lowercase[0], length);
+    
+    for(int index = 0; index < tokens.count; ++index)
+    {
+        Token& token = tokens.tokens[index];
+        token.lower = std::string_view(tokens.lowercase).substr(token.column, token.text.size());
+        
+        classifyToken(token);
+    }
+    
+    return true;
+}
+
+
+}  // namespace chip8asm
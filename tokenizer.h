@@ -0,0 +1,299 @@
+#ifndef CHIP8ASM_TOKENIZER_H
+#define CHIP8ASM_TOKENIZER_H
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "instructions.h"
+
+
+namespace chip8asm
+{
+
+
+struct Context;
+
+
+// what a token turned out to be, decided once while splitting the line
+enum TokenKindEnum : uint8_t
+{
+    TOKEN_SYMBOL,            // anything else, such as a label or mnemonic
+    TOKEN_V_REGISTER,        // value is REG_V0 through REG_VF
+    TOKEN_SPECIAL_REGISTER,  // value is one of the other registers
+    TOKEN_INTEGER,           // value is the literal
+    TOKEN_BAD_INTEGER,       // starts like a number but is not one
+    TOKEN_EXPRESSION         // has operators or parentheses, see expression.h
+};
+
+
+struct Token
+{
+    int column;
+    std::string_view text;   // as written, for messages
+    std::string_view lower;  // ascii lowercased, for matching
+    uint8_t kind;
+    int value;
+    
+    constexpr bool isRegister() const  { return kind == TOKEN_V_REGISTER  ||  kind == TOKEN_SPECIAL_REGISTER; }
+    constexpr bool isInteger(int maxValue) const  { return kind == TOKEN_INTEGER  &&  value <= maxValue; }
+};
+
+
+// tokens of one line, stored inline so tokenizing never touches the heap
+inline constexpr int MAX_TOKENS = 256;
+
+struct TokenList
+{
+    Token tokens[MAX_TOKENS];
+    int first;
+    int count;
+    
+    std::string lowercase;   // lowercased copy of the line, reused between lines
+    
+    int size() const  { return count - first; }
+    bool empty() const  { return count == first; }
+    
+    Token& operator[](int index)  { return tokens[first + index]; }
+    
+    void clear()  { first = count = 0; }
+    void pop_front()  { ++first; }
+};
+
+
+// the rules for what a token is are constexpr, so the compile-time front
+// end in compiletime.h reads source exactly the way split() does
+constexpr char toLowerAscii(char c)
+{
+    return (c >= 'A'  &&  c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+// value of a digit in any base up to 16, or 16 for anything else
+constexpr unsigned digitValue(char c)
+{
+    if(c >= '0'  &&  c <= '9')
+        return c - '0';
+    
+    c |= 0x20;
+    
+    if(c >= 'a'  &&  c <= 'f')
+        return c - 'a' + 10;
+    
+    return 16;
+}
+
+
+// accepts $hex, %binary, 0x hex, 0 octal and decimal; there is no sign, so
+// negative numbers are rejected along with anything past maxValue
+constexpr bool parseInteger(std::string_view text, int& result, int maxValue = 0)
+{
+    unsigned base = 10;
+    size_t index = 0;
+    
+    if(text.empty())
+        return false;
+    
+    if(text[0] == '$')
+    {
+        base = 16;
+        index = 1;
+    }
+    else if(text[0] == '%')
+    {
+        base = 2;
+        index = 1;
+    }
+    else if(text[0] == '0'  &&  text.size() > 1)
+    {
+        bool hex = (text[1] | 0x20) == 'x';
+        
+        base = hex ? 16 : 8;
+        index = hex ? 2 : 1;
+    }
+    
+    if(index == text.size())
+        return false;
+    
+    
+    // the whole token must be a number, otherwise it may be a label
+    unsigned limit = maxValue > 0 ? maxValue : INT_MAX;
+    unsigned value = 0;
+    
+    for(; index < text.size(); ++index)
+    {
+        unsigned digit = digitValue(text[index]);
+        
+        if(digit >= base  ||  digit > limit  ||  value > (limit - digit) / base)
+            return false;
+        
+        value = value * base + digit;
+    }
+    
+    result = (int) value;
+    return true;
+}
+
+
+// expects lowercase text, as in Token::lower
+constexpr bool parseRegister(std::string_view lower, int& result)
+{
+    switch(lower.size())
+    {
+        case 1:
+            switch(lower[0])
+            {
+                case 'b':  result = REG_B;  return true;
+                case 'f':  result = REG_F;  return true;
+                case 'i':  result = REG_I;  return true;
+                case 'k':  result = REG_K;  return true;
+            }
+            
+            return false;
+        
+        case 2:
+            if(lower[0] == 'v')
+            {
+                char c = lower[1];
+                
+                if(c >= '0'  &&  c <= '9')
+                    result = REG_V0 + (c - '0');
+                else if(c >= 'a'  &&  c <= 'f')
+                    result = REG_VA + (c - 'a');
+                else
+                    return false;
+                
+                return true;
+            }
+            
+            if(lower == "dt")
+                result = REG_DT;
+            else if(lower == "st")
+                result = REG_ST;
+            else
+                return false;
+            
+            return true;
+        
+        case 3:
+            if(lower != "[i]")
+                return false;
+            
+            result = REG_I_INDIRECT;
+            return true;
+    }
+    
+    return false;
+}
+
+
+// the operators and parentheses of an expression
+constexpr bool isExpressionCharacter(char c)
+{
+    switch(c)
+    {
+        case '+':  case '-':  case '*':  case '/':  case '<':  case '>':
+        case '&':  case '|':  case '~':  case '(':  case ')':
+            return true;
+    }
+    
+    return false;
+}
+
+
+constexpr bool hasExpressionCharacter(std::string_view text)
+{
+    for(char c : text)
+    {
+        if(isExpressionCharacter(c))
+            return true;
+    }
+    
+    return false;
+}
+
+
+constexpr void classifyToken(Token& token)
+{
+    char c = token.lower[0];
+    bool numeric = (c >= '0'  &&  c <= '9')  ||  c == '$'  ||  c == '%';
+    
+    // a whole number has no operators in it, so only the rest are searched
+    if(parseRegister(token.lower, token.value))
+        token.kind = token.value <= REG_VF ? TOKEN_V_REGISTER : TOKEN_SPECIAL_REGISTER;
+    else if(numeric  &&  parseInteger(token.lower, token.value))
+        token.kind = TOKEN_INTEGER;
+    else if(hasExpressionCharacter(token.lower))
+        token.kind = TOKEN_EXPRESSION;
+    else
+        token.kind = numeric ? TOKEN_BAD_INTEGER : TOKEN_SYMBOL;
+}
+
+
+// an expression may have spaces around its operators, which splits it over
+// several tokens; two go together when an operator, or the parenthesis
+// after hi or lo, reaches across the gap between them and no comma
+// separates them
+constexpr bool continuesExpression(const Token& previous, const Token& token)
+{
+    char before = previous.text.back();
+    char after = token.text[0];
+    std::string_view ending = previous.lower.substr(previous.lower.size() < 2 ? 0 : previous.lower.size() - 2);
+    
+    if(!(isExpressionCharacter(before)  &&  before != ')')  &&  !(isExpressionCharacter(after)  &&  after != '('  &&  after != '~')  &&
+        !(after == '('  &&  (ending == "hi"  ||  ending == "lo")))
+        return false;
+    
+    for(const char *gap = previous.text.data() + previous.text.size(); gap < token.text.data(); ++gap)
+    {
+        if(*gap == ',')
+            return false;
+    }
+    
+    return true;
+}
+
+
+// joins the operands after tokens[0] back into whole expressions; returns
+// the new token count
+constexpr int joinExpressions(Token *tokens, int count)
+{
+    int last = 0;
+    
+    for(int index = 1; index < count; ++index)
+    {
+        Token& previous = tokens[last];
+        const Token& token = tokens[index];
+        
+        // an operator makes a token an expression, so most pairs stop here
+        bool joined = last > 0  &&  (previous.kind == TOKEN_EXPRESSION  ||  token.kind == TOKEN_EXPRESSION)  &&
+            continuesExpression(previous, token);
+        
+        if(!joined)
+        {
+            if(++last != index)
+                tokens[last] = token;
+            
+            continue;
+        }
+        
+        size_t length = token.text.data() + token.text.size() - previous.text.data();
+        
+        previous.text = std::string_view(previous.text.data(), length);
+        previous.lower = std::string_view(previous.lower.data(), length);
+        classifyToken(previous);
+    }
+    
+    return count ? last + 1 : 0;
+}
+
+
+bool equalsIgnoreCase(std::string_view text, std::string_view lowercase);
+bool split(Context& context, std::string_view line, TokenList& tokens);
+
+
+}  // namespace chip8asm
+
+
+#endif